@@ -0,0 +1,206 @@
+/*
+ * This file is part of hx - a hex editor for the terminal.
+ *
+ * Copyright (c) 2016 Kevin Pors. See LICENSE for details.
+ */
+
+/*
+ * Microbenchmarks for the hot paths: the insert and delete primitives,
+ * searching a large corpus and rendering a screen of contents. Build with
+ * `make bench' and run `./bench'; every benchmark reports ns/op, bytes/op
+ * and the resulting throughput, so a change to the storage engine or the
+ * render loop can be judged on numbers instead of feel.
+ *
+ * The harness drives the editor APIs headlessly: nothing is written to
+ * the terminal and no input is read.
+ */
+
+#include "charbuf.h"
+#include "content.h"
+#include "editor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Sizes of the synthetic corpora. The search corpus is deliberately
+// large, since scan throughput only shows at sizes where the buffer does
+// not fit any cache.
+#define BENCH_INSERT_OPS   (1000 * 1000)
+#define BENCH_DELETE_OPS   (100 * 1000)
+#define BENCH_DELETE_SIZE  (64 * 1024 * 1024)
+#define BENCH_SEARCH_SIZE  (256 * 1024 * 1024)
+#define BENCH_SEARCH_OPS   5
+#define BENCH_RENDER_OPS   (20 * 1000)
+#define BENCH_RENDER_SIZE  (16 * 1024 * 1024)
+
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Prints one result line. `bytes' is the total amount of bytes the
+ * benchmark processed, over all ops.
+ */
+static void report(const char* name, double ns, double ops, double bytes) {
+	printf("%-32s %10.0f ops %12.1f ns/op %10.1f B/op %10.1f MB/s\n",
+			name, ops, ns / ops, bytes / ops, bytes / (ns / 1e9) / 1e6);
+}
+
+/*
+ * Fills `buf' with deterministic pseudo-random bytes (xorshift), fast
+ * enough that corpus setup does not dominate the run time.
+ */
+static void fill_random(char* buf, size_t len) {
+	unsigned long long x = 88172645463325252ull;
+	for (size_t i = 0; i < len; i += 8) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		size_t n = len - i < 8 ? len - i : 8;
+		memcpy(buf + i, &x, n);
+	}
+}
+
+static char* xmalloc(size_t len) {
+	char* buf = malloc(len);
+	if (buf == NULL) {
+		perror("Unable to allocate benchmark corpus");
+		exit(1);
+	}
+	return buf;
+}
+
+/*
+ * Storm of single-byte inserts at the end of the buffer, the pattern a
+ * paste or a long typing session produces.
+ */
+static void bench_insert() {
+	struct editor* e = editor_init();
+	e->contents = content_init();
+
+	double start = now_ns();
+	for (size_t i = 0; i < BENCH_INSERT_OPS; i++) {
+		editor_insert_byte_at_offset(e, i, (char) i, false);
+	}
+	double ns = now_ns() - start;
+
+	report("insert_byte_at_offset/end", ns, BENCH_INSERT_OPS, BENCH_INSERT_OPS);
+	editor_free(e);
+}
+
+/*
+ * Single-byte inserts at the front, the worst case for a flat buffer:
+ * every insert used to memmove the entire contents.
+ */
+static void bench_insert_front() {
+	struct editor* e = editor_init();
+	size_t len = BENCH_DELETE_SIZE;
+	char* buf = xmalloc(len);
+	fill_random(buf, len);
+	e->contents = content_from_buffer(buf, len);
+
+	double start = now_ns();
+	for (size_t i = 0; i < BENCH_DELETE_OPS; i++) {
+		editor_insert_byte_at_offset(e, 0, (char) i, false);
+	}
+	double ns = now_ns() - start;
+
+	report("insert_byte_at_offset/front", ns, BENCH_DELETE_OPS, BENCH_DELETE_OPS);
+	editor_free(e);
+}
+
+/*
+ * Deletes at the front of a large buffer, the delete-side worst case for
+ * a flat buffer.
+ */
+static void bench_delete_front() {
+	struct editor* e = editor_init();
+	size_t len = BENCH_DELETE_SIZE;
+	char* buf = xmalloc(len);
+	fill_random(buf, len);
+	e->contents = content_from_buffer(buf, len);
+
+	double start = now_ns();
+	for (size_t i = 0; i < BENCH_DELETE_OPS; i++) {
+		editor_delete_char_at_offset(e, 0);
+	}
+	double ns = now_ns() - start;
+
+	report("delete_char_at_offset/front", ns, BENCH_DELETE_OPS, BENCH_DELETE_OPS);
+	editor_free(e);
+}
+
+/*
+ * Full scan of a large corpus for a needle placed at the very end, the
+ * path behind '/' searches and the n/N match index build.
+ */
+static void bench_search() {
+	size_t len = BENCH_SEARCH_SIZE;
+	char* buf = xmalloc(len);
+	fill_random(buf, len);
+
+	static const char needle[] = "\x00N>E>E>D\x00";
+	size_t needle_len = sizeof(needle) - 1;
+	memcpy(buf + len - needle_len, needle, needle_len);
+
+	struct content* c = content_from_buffer(buf, len);
+
+	double start = now_ns();
+	for (int i = 0; i < BENCH_SEARCH_OPS; i++) {
+		long long found = content_search_forward(c, needle, needle_len, 0);
+		if (found != (long long) (len - needle_len)) {
+			fprintf(stderr, "bench_search: needle not found\n");
+			exit(1);
+		}
+	}
+	double ns = now_ns() - start;
+
+	report("content_search_forward/256MB", ns, BENCH_SEARCH_OPS,
+			(double) len * BENCH_SEARCH_OPS);
+	content_free(c);
+}
+
+/*
+ * Renders full screens of contents into a charbuf, the cost of one frame
+ * without the terminal write.
+ */
+static void bench_render() {
+	struct editor* e = editor_init();
+	size_t len = BENCH_RENDER_SIZE;
+	char* buf = xmalloc(len);
+	fill_random(buf, len);
+	e->contents = content_from_buffer(buf, len);
+	e->screen_rows = 40;
+	e->screen_cols = 120;
+
+	struct charbuf* b = charbuf_create();
+	size_t bytes_per_frame = (size_t) (e->screen_rows - 1) * e->octets_per_line;
+
+	double start = now_ns();
+	for (size_t i = 0; i < BENCH_RENDER_OPS; i++) {
+		charbuf_reset(b);
+		// Move through the file so the render is not served from a
+		// single cached piece lookup position.
+		e->line = (long long) (i % 1000) * 100;
+		editor_render_contents(e, b);
+	}
+	double ns = now_ns() - start;
+
+	report("render_contents/40x16", ns, BENCH_RENDER_OPS,
+			(double) bytes_per_frame * BENCH_RENDER_OPS);
+	charbuf_free(b);
+	editor_free(e);
+}
+
+int main() {
+	bench_insert();
+	bench_insert_front();
+	bench_delete_front();
+	bench_search();
+	bench_render();
+	return 0;
+}
@@ -8,6 +8,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -39,17 +40,24 @@ void charbuf_free(struct charbuf* buf) {
 }
 
 /*
- * Appends `what' to the charbuf, writing at most `len' bytes. Note that
- * if we use snprintf() to format a particular string, we have to subtract
- * 1 from the `len', to discard the null terminator character.
+ * Empties the charbuf, but keeps its allocated capacity.
  */
-void charbuf_append(struct charbuf* buf, const char* what, size_t len) {
-	assert(what != NULL);
+void charbuf_reset(struct charbuf* buf) {
+	buf->len = 0;
+}
+
+/*
+ * Ensures the charbuf has room for at least `n' more bytes after its
+ * current contents.
+ */
+// Largest capacity any charbuf ever grew to, see charbuf_high_water.
+static size_t high_water = 0;
 
+void charbuf_reserve(struct charbuf* buf, size_t n) {
 	// Prevent reallocing a lot by using some sort of geometric progression
-	// by increasing the cap with len, then doubling it.
-	if ((int)(buf->len + len) >= buf->cap) {
-		buf->cap += len;
+	// by increasing the cap with n, then doubling it.
+	if ((int)(buf->len + n) >= buf->cap) {
+		buf->cap += n;
 		buf->cap *= 2;
 		// reallocate with twice the capacity
 		buf->contents = realloc(buf->contents, buf->cap);
@@ -57,7 +65,25 @@ void charbuf_append(struct charbuf* buf, const char* what, size_t len) {
 			perror("Unable to realloc charbuf");
 			exit(1);
 		}
+		if ((size_t) buf->cap > high_water) {
+			high_water = buf->cap;
+		}
 	}
+}
+
+size_t charbuf_high_water() {
+	return high_water;
+}
+
+/*
+ * Appends `what' to the charbuf, writing at most `len' bytes. Note that
+ * if we use snprintf() to format a particular string, we have to subtract
+ * 1 from the `len', to discard the null terminator character.
+ */
+void charbuf_append(struct charbuf* buf, const char* what, size_t len) {
+	assert(what != NULL);
+
+	charbuf_reserve(buf, len);
 
 	// copy 'what' to the target memory
 	memcpy(buf->contents + buf->len, what, len);
@@ -66,25 +92,142 @@ void charbuf_append(struct charbuf* buf, const char* what, size_t len) {
 
 int charbuf_appendf(struct charbuf* buf, const char* fmt, ...) {
 	assert(strlen(fmt) < CHARBUF_APPENDF_SIZE);
-	// We use a fixed size buffer. We don't need to fmt a lot
-	// of characters anyway.
-	char buffer[CHARBUF_APPENDF_SIZE];
+
+	// Format directly into the reserved tail of the buffer, instead of
+	// through an intermediate stack buffer and a copy.
+	charbuf_reserve(buf, CHARBUF_APPENDF_SIZE);
+
 	va_list ap;
 	va_start(ap, fmt);
-	int len = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+	int len = vsnprintf(buf->contents + buf->len, CHARBUF_APPENDF_SIZE, fmt, ap);
 	va_end(ap);
 
-	charbuf_append(buf, buffer, len);
+	// vsnprintf returns the length the output would have had, which is
+	// larger than what was actually written when it got truncated.
+	if (len >= (int) CHARBUF_APPENDF_SIZE) {
+		len = CHARBUF_APPENDF_SIZE - 1;
+	}
+	buf->len += len;
+	return len;
+}
+
+/*
+ * The previously drawn frame, kept to diff the next frame against. The
+ * screen always reflects the last frame handed to charbuf_draw, so any
+ * part of the new frame that is byte-identical does not have to be sent
+ * again. On a slow link the full escape-laden screen per keypress is the
+ * dominant latency; the diff cuts a frame down to the few runs that
+ * actually changed, like the ruler's offset counter.
+ */
+static char*  prev_frame = NULL;
+static size_t prev_len = 0;
+static size_t prev_cap = 0;
+static bool   prev_valid = false;
+
+void charbuf_draw_invalidate() {
+	prev_valid = false;
+}
+
+/*
+ * Returns the offset of the next absolute cursor position escape
+ * (CSI Pn;Pn H) at or after `from', or `len' when there is none. Frames
+ * are diffed in the segments between those escapes: every segment starts
+ * by positioning itself, so an unchanged segment can be skipped without
+ * displacing what comes after it.
+ */
+static size_t frame_next_segment(const char* s, size_t len, size_t from) {
+	for (size_t i = from; i + 2 < len; i++) {
+		if (s[i] != '\x1b' || s[i + 1] != '[') {
+			continue;
+		}
+		size_t j = i + 2;
+		while (j < len && ((s[j] >= '0' && s[j] <= '9') || s[j] == ';')) {
+			j++;
+		}
+		if (j < len && s[j] == 'H') {
+			return i;
+		}
+	}
 	return len;
 }
 
 /*
- * Draws (writes) the charbuf to the screen.
+ * Whether the frame contains a whole-screen erase. Segments after one
+ * must be redrawn even when they match the previous frame, so such
+ * frames are written in full.
+ */
+static bool frame_has_clear(const char* s, size_t len) {
+	for (size_t i = 0; i + 4 <= len; i++) {
+		if (memcmp(s + i, "\x1b[2J", 4) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Stores the frame as the reference the next draw diffs against.
+ */
+static void frame_store(struct charbuf* buf) {
+	if ((size_t) buf->len > prev_cap) {
+		prev_cap = buf->len;
+		prev_frame = realloc(prev_frame, prev_cap);
+		if (prev_frame == NULL) {
+			perror("Unable to realloc previous frame");
+			exit(1);
+		}
+	}
+	memcpy(prev_frame, buf->contents, buf->len);
+	prev_len = buf->len;
+	prev_valid = true;
+}
+
+/*
+ * Draws (writes) the charbuf to the screen. Frames are diffed against
+ * the previously drawn one segment by segment; only changed segments are
+ * written, each preceded by an attribute reset so a skipped neighbour
+ * cannot leak color state into it. (The renderers never rely on colors
+ * carrying over a position escape: every segment sets its own.)
  */
 void charbuf_draw(struct charbuf* buf) {
-	if (write(STDOUT_FILENO, buf->contents, buf->len) == -1) {
+	if (!prev_valid || frame_has_clear(buf->contents, buf->len)) {
+		if (write(STDOUT_FILENO, buf->contents, buf->len) == -1) {
+			perror("Can't write charbuf");
+			exit(1);
+		}
+		frame_store(buf);
+		return;
+	}
+
+	// The delta lives for the process like the frame buffer does, so
+	// steady-state draws do not touch the allocator.
+	static struct charbuf* delta = NULL;
+	if (delta == NULL) {
+		delta = charbuf_create();
+	}
+	charbuf_reset(delta);
+
+	// Walk the segments of both frames in lockstep. A segment is skipped
+	// only when it is byte-identical to its counterpart - including its
+	// position escape - in which case its effect is already on screen.
+	size_t np = 0;
+	size_t pp = 0;
+	while (np < (size_t) buf->len) {
+		size_t ne = frame_next_segment(buf->contents, buf->len, np + 1);
+		size_t pe = frame_next_segment(prev_frame, prev_len, pp + 1);
+		if (ne - np != pe - pp
+				|| memcmp(buf->contents + np, prev_frame + pp, ne - np) != 0) {
+			charbuf_append(delta, "\x1b[0m", 4);
+			charbuf_append(delta, buf->contents + np, ne - np);
+		}
+		np = ne;
+		pp = pe;
+	}
+
+	if (delta->len > 0 && write(STDOUT_FILENO, delta->contents, delta->len) == -1) {
 		perror("Can't write charbuf");
 		exit(1);
 	}
+	frame_store(buf);
 }
 
@@ -33,6 +33,19 @@ struct charbuf* charbuf_create();
  */
 void charbuf_free(struct charbuf* buf);
 
+/*
+ * Empties the charbuf, but keeps its allocated capacity. Use this to
+ * reuse one buffer across screen refreshes instead of a create/free
+ * (and the realloc churn to grow it back) per frame.
+ */
+void charbuf_reset(struct charbuf* buf);
+
+/*
+ * Ensures the charbuf has room for at least `n' more bytes after its
+ * current contents, growing it geometrically when needed.
+ */
+void charbuf_reserve(struct charbuf* buf, size_t n);
+
 /*
  * Appends `what' to the charbuf, writing exactly `len' bytes.
  */
@@ -49,8 +62,25 @@ void charbuf_append(struct charbuf* buf, const char* what, size_t len);
 int charbuf_appendf(struct charbuf* buf, const char* what, ...);
 
 /*
- * Draws (writes) the charbuf to the screen.
+ * Draws (writes) the charbuf to the screen. Only the parts that changed
+ * since the previous draw are actually written: the frame is diffed
+ * against the last drawn one in the segments between absolute cursor
+ * position escapes, which cuts the bandwidth to the terminal from a full
+ * screen per keypress to the few runs that changed.
  */
 void charbuf_draw(struct charbuf* buf);
 
+/*
+ * Forgets the previously drawn frame, forcing the next charbuf_draw to
+ * write everything. Must be called whenever the screen is changed behind
+ * the diff's back (e.g. clear_screen writing to the terminal directly).
+ */
+void charbuf_draw_invalidate();
+
+/*
+ * Returns the largest capacity any charbuf ever grew to, in bytes. Shown
+ * by the performance HUD as a proxy for the frame buffer memory cost.
+ */
+size_t charbuf_high_water();
+
 #endif // HX_CHARBUF_H
@@ -0,0 +1,684 @@
+/*
+ * This file is part of hx - a hex editor for the terminal.
+ *
+ * Copyright (c) 2016 Kevin Pors. See LICENSE for details.
+ */
+
+#include "content.h"
+#include "util.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+// Size of the scratch buffer used by the chunked search functions. Searches
+// read the contents through the piece table in runs of this size so the
+// needle comparison itself can use plain contiguous memory.
+#define CONTENT_SEARCH_CHUNK 65536
+
+/*
+ * Returns a pointer to the first byte of the run a piece describes.
+ */
+static inline char* piece_data(struct content* c, struct piece* p) {
+	return (p->in_add ? c->add : c->orig) + p->start;
+}
+
+/*
+ * Allocates a new piece for the given run.
+ */
+static struct piece* piece_create(bool in_add, size_t start, size_t len) {
+	struct piece* p = malloc(sizeof(struct piece));
+	if (p == NULL) {
+		perror("Unable to allocate piece");
+		exit(1);
+	}
+	p->prev = NULL;
+	p->next = NULL;
+	p->in_add = in_add;
+	p->start = start;
+	p->len = len;
+	return p;
+}
+
+/*
+ * Links piece `p' into the list directly after `after'. When `after' is
+ * NULL, `p' becomes the new head.
+ */
+static void piece_link_after(struct content* c, struct piece* after, struct piece* p) {
+	p->prev = after;
+	if (after == NULL) {
+		p->next = c->head;
+		c->head = p;
+	} else {
+		p->next = after->next;
+		after->next = p;
+	}
+	if (p->next != NULL) {
+		p->next->prev = p;
+	} else {
+		c->tail = p;
+	}
+}
+
+/*
+ * Unlinks piece `p' from the list and frees it.
+ */
+static void piece_unlink(struct content* c, struct piece* p) {
+	if (p->prev != NULL) {
+		p->prev->next = p->next;
+	} else {
+		c->head = p->next;
+	}
+	if (p->next != NULL) {
+		p->next->prev = p->prev;
+	} else {
+		c->tail = p->prev;
+	}
+	free(p);
+}
+
+/*
+ * Finds the piece containing the byte at logical offset `offset'. The
+ * position of the byte within the piece is stored in `pos'. The offset
+ * must be less than the total length.
+ *
+ * The walk starts from the cached piece of the previous lookup when
+ * available, so access patterns with locality (rendering a screen,
+ * searching, typing) do not walk the whole list every time.
+ */
+static struct piece* piece_find(struct content* c, size_t offset, size_t* pos) {
+	assert(offset < c->length);
+
+	struct piece* p;
+	size_t p_offset; // logical offset of the first byte of p.
+
+	if (c->cache != NULL && c->cache_offset <= offset) {
+		p = c->cache;
+		p_offset = c->cache_offset;
+	} else {
+		p = c->head;
+		p_offset = 0;
+	}
+
+	while (offset >= p_offset + p->len) {
+		p_offset += p->len;
+		p = p->next;
+	}
+
+	c->cache = p;
+	c->cache_offset = p_offset;
+
+	*pos = offset - p_offset;
+	return p;
+}
+
+/*
+ * Splits piece `p' at position `pos' (which must be within the piece, and
+ * non-zero) so that `p' keeps the first `pos' bytes and a newly linked
+ * piece holds the remainder. Returns the new right-hand piece.
+ */
+static struct piece* piece_split(struct content* c, struct piece* p, size_t pos) {
+	assert(pos > 0 && pos < p->len);
+
+	struct piece* right = piece_create(p->in_add, p->start + pos, p->len - pos);
+	p->len = pos;
+	piece_link_after(c, p, right);
+	return right;
+}
+
+/*
+ * Appends a byte to the add buffer, growing it geometrically when needed.
+ * Returns the position of the byte within the add buffer.
+ */
+static size_t add_append(struct content* c, char x) {
+	if (c->add_len >= c->add_cap) {
+		c->add_cap = c->add_cap == 0 ? 256 : c->add_cap * 2;
+		c->add = realloc(c->add, c->add_cap);
+		if (c->add == NULL) {
+			perror("Unable to realloc add buffer");
+			exit(1);
+		}
+	}
+	c->add[c->add_len] = x;
+	return c->add_len++;
+}
+
+/*
+ * Ensures the add buffer has room for `len' more bytes, growing it
+ * geometrically when needed.
+ */
+static void add_reserve(struct content* c, size_t len) {
+	if (c->add_len + len > c->add_cap) {
+		while (c->add_len + len > c->add_cap) {
+			c->add_cap = c->add_cap == 0 ? 256 : c->add_cap * 2;
+		}
+		c->add = realloc(c->add, c->add_cap);
+		if (c->add == NULL) {
+			perror("Unable to realloc add buffer");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Appends a run of `len' bytes to the add buffer in one go. Returns the
+ * position of the first byte within the add buffer.
+ */
+static size_t add_append_run(struct content* c, const char* buf, size_t len) {
+	add_reserve(c, len);
+	memcpy(c->add + c->add_len, buf, len);
+	size_t start = c->add_len;
+	c->add_len += len;
+	return start;
+}
+
+struct content* content_init() {
+	struct content* c = malloc(sizeof(struct content));
+	if (c == NULL) {
+		perror("Unable to allocate struct content");
+		exit(1);
+	}
+	c->orig = NULL;
+	c->orig_len = 0;
+	c->orig_mmapped = false;
+	c->orig_mirrors_file = false;
+	c->add = NULL;
+	c->add_len = 0;
+	c->add_cap = 0;
+	c->head = NULL;
+	c->tail = NULL;
+	c->length = 0;
+	c->cache = NULL;
+	c->cache_offset = 0;
+	return c;
+}
+
+struct content* content_from_buffer(char* buf, size_t len) {
+	struct content* c = content_init();
+	c->orig = buf;
+	c->orig_len = len;
+	c->orig_mirrors_file = true;
+	if (len > 0) {
+		struct piece* p = piece_create(false, 0, len);
+		c->head = p;
+		c->tail = p;
+	}
+	c->length = len;
+	return c;
+}
+
+struct content* content_from_mmap(char* map, size_t len) {
+	struct content* c = content_from_buffer(map, len);
+	c->orig_mmapped = true;
+	return c;
+}
+
+void content_free(struct content* c) {
+	struct piece* p = c->head;
+	while (p != NULL) {
+		struct piece* next = p->next;
+		free(p);
+		p = next;
+	}
+	if (c->orig_mmapped) {
+		munmap(c->orig, c->orig_len);
+	} else {
+		free(c->orig);
+	}
+	free(c->add);
+	free(c);
+}
+
+/*
+ * Clones a piece chain. Returns the head of the clone; the tail is
+ * stored in `tail' when it is non-NULL.
+ */
+static struct piece* piece_chain_clone(struct piece* head, struct piece** tail) {
+	struct piece* clone_head = NULL;
+	struct piece* clone_tail = NULL;
+	for (struct piece* p = head; p != NULL; p = p->next) {
+		struct piece* q = piece_create(p->in_add, p->start, p->len);
+		q->prev = clone_tail;
+		if (clone_tail == NULL) {
+			clone_head = q;
+		} else {
+			clone_tail->next = q;
+		}
+		clone_tail = q;
+	}
+	if (tail != NULL) {
+		*tail = clone_tail;
+	}
+	return clone_head;
+}
+
+/*
+ * Frees every piece of a chain.
+ */
+static void piece_chain_free(struct piece* head) {
+	while (head != NULL) {
+		struct piece* next = head->next;
+		free(head);
+		head = next;
+	}
+}
+
+struct content_snapshot* content_snapshot_take(struct content* c) {
+	struct content_snapshot* s = malloc(sizeof(struct content_snapshot));
+	if (s == NULL) {
+		perror("Unable to allocate snapshot");
+		exit(1);
+	}
+	s->head = piece_chain_clone(c->head, NULL);
+	s->length = c->length;
+	return s;
+}
+
+void content_snapshot_restore(struct content* c, struct content_snapshot* s) {
+	piece_chain_free(c->head);
+	// Install a clone, so the snapshot survives to be restored again.
+	c->head = piece_chain_clone(s->head, &c->tail);
+	c->length = s->length;
+	c->cache = NULL;
+	c->cache_offset = 0;
+}
+
+void content_snapshot_free(struct content_snapshot* s) {
+	piece_chain_free(s->head);
+	free(s);
+}
+
+char content_byte_at(struct content* c, size_t offset) {
+	size_t pos;
+	struct piece* p = piece_find(c, offset, &pos);
+	return piece_data(c, p)[pos];
+}
+
+size_t content_read(struct content* c, size_t offset, char* dst, size_t len) {
+	if (offset >= c->length) {
+		return 0;
+	}
+	if (len > c->length - offset) {
+		len = c->length - offset;
+	}
+
+	size_t pos;
+	struct piece* p = piece_find(c, offset, &pos);
+
+	size_t copied = 0;
+	while (copied < len) {
+		size_t run = p->len - pos;
+		if (run > len - copied) {
+			run = len - copied;
+		}
+		memcpy(dst + copied, piece_data(c, p) + pos, run);
+		copied += run;
+		p = p->next;
+		pos = 0;
+	}
+	return copied;
+}
+
+void content_insert_byte(struct content* c, size_t offset, char x) {
+	assert(offset <= c->length);
+
+	size_t a = add_append(c, x);
+
+	if (c->head == NULL) {
+		// First byte of an empty file.
+		struct piece* p = piece_create(true, a, 1);
+		c->head = p;
+		c->tail = p;
+		c->cache = p;
+		c->cache_offset = 0;
+		c->length++;
+		return;
+	}
+
+	if (offset == c->length) {
+		// Appending to the end. When the tail already ends right where
+		// the new byte landed in the add buffer, just grow it: this is
+		// the common case of typing a run of bytes.
+		if (c->tail->in_add && c->tail->start + c->tail->len == a) {
+			c->tail->len++;
+		} else {
+			piece_link_after(c, c->tail, piece_create(true, a, 1));
+		}
+		c->length++;
+		return;
+	}
+
+	size_t pos;
+	struct piece* p = piece_find(c, offset, &pos);
+
+	if (pos == 0 && p->prev != NULL && p->prev->in_add
+			&& p->prev->start + p->prev->len == a) {
+		// Inserting directly after a piece which ends right where the
+		// new byte landed: grow it instead of splitting. This keeps a
+		// run of consecutively typed bytes in a single piece.
+		p->prev->len++;
+		c->cache_offset++;
+	} else if (pos == 0) {
+		piece_link_after(c, p->prev, piece_create(true, a, 1));
+		c->cache_offset++;
+	} else {
+		struct piece* right = piece_split(c, p, pos);
+		piece_link_after(c, p, piece_create(true, a, 1));
+		(void) right;
+	}
+	c->length++;
+}
+
+/*
+ * Splices a piece covering the add buffer run [a, a + len) into the table
+ * at logical offset `offset'. The run must already be in the add buffer.
+ */
+static void insert_run(struct content* c, size_t offset, size_t a, size_t len) {
+	struct piece* span = piece_create(true, a, len);
+
+	if (c->head == NULL || offset == c->length) {
+		piece_link_after(c, c->tail, span);
+	} else {
+		size_t pos;
+		struct piece* p = piece_find(c, offset, &pos);
+		if (pos == 0) {
+			piece_link_after(c, p->prev, span);
+			// The cached piece is `p', which just shifted.
+			c->cache_offset += len;
+		} else {
+			piece_split(c, p, pos);
+			piece_link_after(c, p, span);
+		}
+	}
+	c->length += len;
+}
+
+void content_insert(struct content* c, size_t offset, const char* buf, size_t len) {
+	assert(offset <= c->length);
+
+	if (len == 0) {
+		return;
+	}
+
+	size_t a = add_append_run(c, buf, len);
+	insert_run(c, offset, a, len);
+}
+
+void content_delete(struct content* c, size_t offset, size_t len) {
+	assert(offset + len <= c->length);
+
+	if (len == 0) {
+		return;
+	}
+
+	size_t pos;
+	struct piece* p = piece_find(c, offset, &pos);
+
+	// The cache may end up pointing into the deleted range; simply reset
+	// it so the next lookup walks from the head again.
+	c->cache = NULL;
+	c->cache_offset = 0;
+
+	size_t remaining = len;
+	if (pos > 0) {
+		if (pos + remaining < p->len) {
+			// The range lies entirely inside one piece: split it and
+			// shrink the right-hand part.
+			struct piece* right = piece_split(c, p, pos);
+			right->start += remaining;
+			right->len -= remaining;
+			c->length -= len;
+			return;
+		}
+		// Trim the tail of the first piece, then continue with whole
+		// pieces.
+		remaining -= p->len - pos;
+		struct piece* next = p->next;
+		p->len = pos;
+		p = next;
+	}
+
+	// Drop the pieces the range fully covers, and trim the head of the
+	// piece the range ends in.
+	while (remaining > 0 && remaining >= p->len) {
+		struct piece* next = p->next;
+		remaining -= p->len;
+		piece_unlink(c, p);
+		p = next;
+	}
+	if (remaining > 0) {
+		p->start += remaining;
+		p->len -= remaining;
+	}
+	c->length -= len;
+}
+
+void content_replace(struct content* c, size_t offset, const char* buf, size_t len) {
+	assert(offset + len <= c->length);
+
+	if (len == 0) {
+		return;
+	}
+
+	content_delete(c, offset, len);
+	size_t a = add_append_run(c, buf, len);
+	insert_run(c, offset, a, len);
+}
+
+void content_fill(struct content* c, size_t offset, size_t len, char x) {
+	assert(offset + len <= c->length);
+
+	if (len == 0) {
+		return;
+	}
+
+	// The fill run is memset straight into the add buffer, so no
+	// temporary buffer of `len' bytes is needed.
+	add_reserve(c, len);
+	size_t a = c->add_len;
+	memset(c->add + a, x, len);
+	c->add_len += len;
+
+	content_delete(c, offset, len);
+	insert_run(c, offset, a, len);
+}
+
+void content_delete_byte(struct content* c, size_t offset) {
+	assert(offset < c->length);
+
+	size_t pos;
+	struct piece* p = piece_find(c, offset, &pos);
+
+	// The cache may end up pointing past the deleted byte; simply reset
+	// it so the next lookup walks from the head again.
+	c->cache = NULL;
+	c->cache_offset = 0;
+
+	if (p->len == 1) {
+		piece_unlink(c, p);
+	} else if (pos == 0) {
+		p->start++;
+		p->len--;
+	} else if (pos == p->len - 1) {
+		p->len--;
+	} else {
+		struct piece* right = piece_split(c, p, pos);
+		right->start++;
+		right->len--;
+	}
+	c->length--;
+}
+
+void content_replace_byte(struct content* c, size_t offset, char x) {
+	assert(offset < c->length);
+
+	size_t pos;
+	struct piece* p = piece_find(c, offset, &pos);
+
+	size_t a = add_append(c, x);
+
+	if (pos == 0 && p->prev != NULL && p->prev->in_add
+			&& p->prev->start + p->prev->len == a) {
+		// Replacing the byte right after a piece ending at the top of
+		// the add buffer: grow that piece and shrink this one, so a
+		// run of replaces collapses into a single piece.
+		p->prev->len++;
+		if (p->len == 1) {
+			piece_unlink(c, p);
+			c->cache = NULL;
+			c->cache_offset = 0;
+		} else {
+			p->start++;
+			p->len--;
+			c->cache_offset++;
+		}
+		return;
+	}
+
+	if (p->len == 1) {
+		// The whole piece is the one byte being replaced: repoint it.
+		p->in_add = true;
+		p->start = a;
+		return;
+	}
+
+	if (pos == 0) {
+		p->start++;
+		p->len--;
+		piece_link_after(c, p->prev, piece_create(true, a, 1));
+		c->cache_offset++;
+	} else if (pos == p->len - 1) {
+		p->len--;
+		piece_link_after(c, p, piece_create(true, a, 1));
+	} else {
+		struct piece* right = piece_split(c, p, pos);
+		right->start++;
+		right->len--;
+		piece_link_after(c, p, piece_create(true, a, 1));
+	}
+}
+
+void content_iter_init(struct content_iter* it, struct content* c, size_t offset) {
+	it->c = c;
+	it->offset = offset;
+	if (offset >= c->length) {
+		it->piece = NULL;
+		it->pos = 0;
+		return;
+	}
+	it->piece = piece_find(c, offset, &it->pos);
+}
+
+int content_iter_next(struct content_iter* it) {
+	if (it->piece == NULL) {
+		return -1;
+	}
+	unsigned char x = (unsigned char) piece_data(it->c, it->piece)[it->pos];
+	it->offset++;
+	it->pos++;
+	if (it->pos >= it->piece->len) {
+		it->piece = it->piece->next;
+		it->pos = 0;
+	}
+	return x;
+}
+
+bool content_can_patch(struct content* c) {
+	if (!c->orig_mirrors_file) {
+		// The original buffer does not describe the on-disk file (an
+		// imported dump, a revert across a flushed save); patching
+		// against it would leave wrong bytes on disk.
+		return false;
+	}
+	if (c->length != c->orig_len) {
+		return false;
+	}
+
+	size_t offset = 0;
+	for (struct piece* p = c->head; p != NULL; p = p->next) {
+		if (!p->in_add && p->start != offset) {
+			// An untouched run shifted away from its original file
+			// offset (balanced inserts and deletes); patching in
+			// place would corrupt it.
+			return false;
+		}
+		offset += p->len;
+	}
+	return true;
+}
+
+long long content_flush_patch(struct content* c, FILE* fp) {
+	assert(content_can_patch(c));
+
+	long long written = 0;
+	size_t offset = 0;
+	for (struct piece* p = c->head; p != NULL; p = p->next) {
+		if (p->in_add) {
+			if (fseek(fp, offset, SEEK_SET) != 0) {
+				return -1;
+			}
+			if (fwrite(c->add + p->start, sizeof(char), p->len, fp) < p->len) {
+				return -1;
+			}
+			written += p->len;
+		}
+		offset += p->len;
+	}
+	return written;
+}
+
+long long content_search_forward(struct content* c, const char* needle, size_t len, size_t from) {
+	if (len == 0 || len > c->length || len > CONTENT_SEARCH_CHUNK) {
+		return -1;
+	}
+
+	char chunk[CONTENT_SEARCH_CHUNK];
+	size_t offset = from;
+
+	while (offset + len <= c->length) {
+		size_t got = content_read(c, offset, chunk, sizeof(chunk));
+		if (got < len) {
+			break;
+		}
+		char* hit = hx_memmem(chunk, got, needle, len);
+		if (hit != NULL) {
+			return (long long) (offset + (hit - chunk));
+		}
+		// Overlap the chunks by len - 1 bytes so a needle straddling
+		// a chunk boundary is still found.
+		offset += got - (len - 1);
+	}
+	return -1;
+}
+
+long long content_search_backward(struct content* c, const char* needle, size_t len, size_t from) {
+	if (len == 0 || len > c->length || len > CONTENT_SEARCH_CHUNK) {
+		return -1;
+	}
+	if (from + len > c->length) {
+		from = c->length - len;
+	}
+
+	char chunk[CONTENT_SEARCH_CHUNK];
+
+	// `end' is the last offset (inclusive) still to be considered as a
+	// possible match position.
+	size_t end = from;
+	for (;;) {
+		size_t start = end + len >= sizeof(chunk)
+			? end + len - sizeof(chunk) : 0;
+		size_t got = content_read(c, start, chunk, end - start + len);
+		char* hit = hx_memrmem(chunk, got, needle, len);
+		if (hit != NULL) {
+			return (long long) (start + (hit - chunk));
+		}
+		if (start == 0) {
+			break;
+		}
+		end = start - 1;
+	}
+	return -1;
+}
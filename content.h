@@ -0,0 +1,237 @@
+/*
+ * This file is part of hx - a hex editor for the terminal.
+ *
+ * Copyright (c) 2016 Kevin Pors. See LICENSE for details.
+ */
+
+#ifndef HX_CONTENT_H
+#define HX_CONTENT_H
+
+#include <stdbool.h>
+#include <stdio.h>  // FILE
+#include <stdlib.h> // size_t
+
+/*
+ * Contains the storage engine for the file being edited. Instead of keeping
+ * the file in one flat buffer (which requires a memmove of everything after
+ * the cursor plus a realloc for every single inserted or deleted byte), the
+ * contents are kept as a piece table: the original file data is never
+ * modified, every byte ever typed is appended to a separate 'add' buffer,
+ * and a linked list of `piece' descriptors describes which ranges of which
+ * buffer make up the file in logical order. Inserting or deleting a byte
+ * then only splits or resizes a piece, no matter how large the file is.
+ */
+
+/*
+ * A piece describes one contiguous run of the logical file contents. The
+ * run lives either in the original buffer or in the add buffer, starting
+ * at `start' and spanning `len' bytes.
+ */
+struct piece {
+	struct piece* prev; // previous piece, or NULL if this is the first.
+	struct piece* next; // next piece, or NULL if this is the last.
+
+	bool   in_add; // true when the run lives in the add buffer.
+	size_t start;  // start of the run within its buffer.
+	size_t len;    // length of the run in bytes.
+};
+
+struct content {
+	char*  orig;         // the original file data. Never written to.
+	size_t orig_len;     // length of the original data.
+	bool   orig_mmapped; // true when `orig' is an mmap'ed region.
+
+	// Whether the on-disk file still matches `orig' outside the runs the
+	// add pieces cover. Opening a file establishes this; contents that
+	// did not come from the file (an imported hex dump, stdin) or a
+	// restore across a flushed save break it, and content_can_patch then
+	// refuses the in-place save paths, forcing a full rewrite.
+	bool orig_mirrors_file;
+
+	char*  add;     // append-only buffer with every byte written.
+	size_t add_len; // length of the add buffer.
+	size_t add_cap; // capacity of the add buffer.
+
+	struct piece* head; // first piece, or NULL when the file is empty.
+	struct piece* tail; // last piece, or NULL when the file is empty.
+
+	size_t length; // total logical length of the contents.
+
+	// Cache of the piece found by the most recent lookup, together with
+	// the logical offset of its first byte. Sequential access (rendering,
+	// searching, typing) then finds its piece in O(1) instead of walking
+	// the list from the head every time.
+	struct piece* cache;
+	size_t        cache_offset;
+};
+
+/*
+ * A snapshot of the table at one point in time: a private copy of the
+ * piece chain plus the logical length. The chain is one node per edited
+ * run however large the file is, and the data buffers are append-only
+ * (no edit ever rewrites a byte a piece can point at), so taking a
+ * snapshot never copies file contents and restoring one costs only the
+ * pieces, not the bytes.
+ */
+struct content_snapshot {
+	struct piece* head; // private clone of the piece chain, or NULL.
+	size_t length;      // logical length at the time of the snapshot.
+};
+
+/*
+ * An iterator over the logical contents, used by the render and search
+ * paths to read bytes in sequence without paying a piece lookup per byte.
+ */
+struct content_iter {
+	struct content* c;
+	struct piece*   piece;  // piece the next byte lives in, or NULL at end.
+	size_t          pos;    // position of the next byte within `piece'.
+	size_t          offset; // logical offset of the next byte.
+};
+
+/*
+ * Creates an empty content on the heap and returns it.
+ */
+struct content* content_init();
+
+/*
+ * Creates a content from a malloc'd buffer of `len' bytes. The content
+ * takes ownership of the buffer and will free() it in content_free.
+ * The buffer is assumed to be the on-disk file data; callers handing in
+ * anything else must clear `orig_mirrors_file' themselves.
+ */
+struct content* content_from_buffer(char* buf, size_t len);
+
+/*
+ * Creates a content from a read-only mmap'ed region of `len' bytes. The
+ * content takes ownership of the mapping and will munmap() it in
+ * content_free. Since the original data is never written to, edits work
+ * exactly as with a heap buffer: changed bytes go to the add buffer.
+ */
+struct content* content_from_mmap(char* map, size_t len);
+
+/*
+ * Frees the pieces, the buffers and the content itself.
+ */
+void content_free(struct content* c);
+
+/*
+ * Takes a snapshot of the current state of the contents. The caller owns
+ * it and must free it with content_snapshot_free. Snapshots stay valid
+ * across any sequence of edits, since edits only append to the buffers.
+ */
+struct content_snapshot* content_snapshot_take(struct content* c);
+
+/*
+ * Restores the contents to the state a snapshot captured. The snapshot
+ * itself is untouched and can be restored again.
+ */
+void content_snapshot_restore(struct content* c, struct content_snapshot* s);
+
+/*
+ * Frees a snapshot. The contents it was taken from are unaffected.
+ */
+void content_snapshot_free(struct content_snapshot* s);
+
+/*
+ * Returns the byte at logical offset `offset'. The offset must be within
+ * bounds.
+ */
+char content_byte_at(struct content* c, size_t offset);
+
+/*
+ * Copies `len' bytes starting at logical offset `offset' into `dst'.
+ * Returns the amount of bytes actually copied, which may be less than
+ * `len' when the end of the contents is reached.
+ */
+size_t content_read(struct content* c, size_t offset, char* dst, size_t len);
+
+/*
+ * Inserts byte `x' at logical offset `offset'. Everything at and after the
+ * offset shifts one position up. Inserting at offset == length appends.
+ */
+void content_insert_byte(struct content* c, size_t offset, char x);
+
+/*
+ * Inserts `len' bytes from `buf' at logical offset `offset' as a single
+ * splice: the run is appended to the add buffer once and covered by one
+ * piece, so the cost does not depend on the amount of bytes inserted.
+ */
+void content_insert(struct content* c, size_t offset, const char* buf, size_t len);
+
+/*
+ * Deletes the byte at logical offset `offset'.
+ */
+void content_delete_byte(struct content* c, size_t offset);
+
+/*
+ * Deletes `len' bytes starting at logical offset `offset' as a single
+ * splice. At most two pieces are split or trimmed; the pieces the range
+ * fully covers are simply unlinked.
+ */
+void content_delete(struct content* c, size_t offset, size_t len);
+
+/*
+ * Replaces `len' bytes starting at logical offset `offset' with the bytes
+ * in `buf', as two splices (a delete and an insert) whose cost does not
+ * depend on `len'. The logical length is unchanged.
+ */
+void content_replace(struct content* c, size_t offset, const char* buf, size_t len);
+
+/*
+ * Overwrites `len' bytes starting at logical offset `offset' with copies
+ * of byte `x', as two splices. The fill run goes straight into the add
+ * buffer, so no temporary buffer is allocated.
+ */
+void content_fill(struct content* c, size_t offset, size_t len, char x);
+
+/*
+ * Replaces the byte at logical offset `offset' with `x'. The original
+ * buffer is never written; the new byte goes to the add buffer and the
+ * piece table is updated to point at it.
+ */
+void content_replace_byte(struct content* c, size_t offset, char x);
+
+/*
+ * Initializes an iterator pointed at logical offset `offset'.
+ */
+void content_iter_init(struct content_iter* it, struct content* c, size_t offset);
+
+/*
+ * Returns the next byte as an unsigned value, or -1 when the end of the
+ * contents is reached.
+ */
+int content_iter_next(struct content_iter* it);
+
+/*
+ * Returns true when the contents can be flushed back to the original file
+ * by patching only the changed ranges in place: the length must be
+ * unchanged and every untouched run must still sit at its original file
+ * offset. Purely replace-mode edits (the common case on big images)
+ * satisfy this; net inserts or deletes do not.
+ */
+bool content_can_patch(struct content* c);
+
+/*
+ * Writes only the changed ranges of the contents to `fp', which must be
+ * opened for updating ("r+b") on the original file. Only valid when
+ * content_can_patch returns true. Returns the number of bytes written,
+ * or -1 on an I/O error.
+ */
+long long content_flush_patch(struct content* c, FILE* fp);
+
+/*
+ * Searches forward for `needle' (being `len' bytes), starting at logical
+ * offset `from'. Returns the offset of the first occurrence, or -1 when
+ * the needle does not occur. The scan reads through the piece table in
+ * chunks, so it works without the contents being contiguous in memory.
+ */
+long long content_search_forward(struct content* c, const char* needle, size_t len, size_t from);
+
+/*
+ * As content_search_forward, but scans backward starting at (and
+ * including) offset `from'.
+ */
+long long content_search_backward(struct content* c, const char* needle, size_t len, size_t from);
+
+#endif // HX_CONTENT_H
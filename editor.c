@@ -5,20 +5,613 @@
  */
 
 #include "editor.h"
+#include "hash.h"
 #include "util.h"
 #include "undo.h"
 
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+// Files of at least this size are opened with a read-only mmap instead of
+// reading everything into memory up front, so the first screen renders
+// without paying for the whole file. Can be forced for smaller files with
+// the -m command line flag.
+#define MMAP_THRESHOLD (16 * 1024 * 1024)
+
+// Searches over contents smaller than this are done inline on the main
+// thread; anything bigger goes to a worker thread so the status line can
+// show progress and ESC can cancel a scan that takes seconds.
+#define SEARCH_THREAD_THRESHOLD (16 * 1024 * 1024)
+
+// Buffers at or above this size are written on a worker thread when a
+// full rewrite is needed, so the UI shows progress and stays cancellable.
+#define SAVE_THREAD_THRESHOLD (16 * 1024 * 1024)
+
+// Full rewrites stream through chunks of this size.
+#define SAVE_CHUNK (1024 * 1024)
+
+// Contents at least this large are scanned for strings (:strings) on a
+// worker thread, so the status line can show progress and ESC can cancel.
+#define STRINGS_THREAD_THRESHOLD (16 * 1024 * 1024)
+
+// Minimum printable run length :strings uses when none is given, the
+// same default as strings(1).
+#define STRINGS_MIN_DEFAULT 4
+
+// Block size the streaming reader uses for unsized files and stdin.
+#define STREAM_BLOCK (256 * 1024)
+
+// Contents at least this large are scanned for :stats on a worker
+// thread, so the status line can show progress and ESC can cancel.
+#define STATS_THREAD_THRESHOLD (16 * 1024 * 1024)
+
+// Contents at least this large are compared against the -d file on
+// multiple worker threads; smaller ones are compared inline.
+#define DIFF_THREAD_THRESHOLD (16 * 1024 * 1024)
+
+// Amount of worker threads used for a threaded comparison.
+#define DIFF_THREADS 4
+
+// The comparison skips equal data with one memcmp per block of this
+// size; only blocks that differ are scanned per byte.
+#define DIFF_BLOCK 4096
+
+/*
+ * Precomputed render tables, so the per-byte render loop does not need a
+ * snprintf call and an isprint branch for every visible octet. hex_table
+ * holds the two hex chars of every byte value; asc_table holds the char
+ * shown in the ASCII pane (the byte itself when printable, '.' otherwise).
+ */
+static char hex_table[256][2];
+static unsigned char asc_table[256];
+static bool render_tables_ready = false;
+
+// Color attributes used by the run-batched render loops.
+enum {
+	ATTR_PRINT  = 1 << 0, // printable byte: bright blue foreground.
+	ATTR_CURSOR = 1 << 1, // byte under the cursor: reverse video.
+	ATTR_MATCH  = 1 << 2, // part of a search match: yellow background.
+	ATTR_DIFF   = 1 << 3, // differs from the -d comparison file: red background.
+	ATTR_SELECT = 1 << 4, // part of the visual selection: blue background.
+};
+
+static void render_tables_init() {
+	static const char digits[] = "0123456789abcdef";
+	for (int i = 0; i < 256; i++) {
+		hex_table[i][0] = digits[i >> 4];
+		hex_table[i][1] = digits[i & 0xf];
+		asc_table[i] = isprint(i) ? i : '.';
+	}
+	render_tables_ready = true;
+}
+
+/*
+ * Appends the pending run of same-colored chars to the buffer in one go,
+ * instead of a charbuf_append per char.
+ */
+static void render_flush_run(struct charbuf* b, const char* run, int* runlen) {
+	if (*runlen > 0) {
+		charbuf_append(b, run, *runlen);
+		*runlen = 0;
+	}
+}
+
+// Amount of rows kept in the ASCII-pane decode cache. Direct-mapped on the
+// row's start offset; a power of two keeps the slot computation a mask.
+#define ASCII_CACHE_ROWS 128
+
+/*
+ * The decoded state of one ASCII-pane row: the row's bytes and, per byte,
+ * the longest thingy substitution starting there (or NULL). Resolving the
+ * thingies is the expensive part of rendering the pane - one table probe
+ * per key length per byte - and the result only changes when the contents
+ * or the table change, not when the cursor moves. Rows are cached keyed on
+ * their start offset plus a generation counter that every edit and table
+ * change bumps, so steady-state frames and scrolls re-use the decode and
+ * only apply the (per-frame) cursor highlight.
+ */
+struct ascii_cache_row {
+	size_t start_offset;              // first byte of the row.
+	unsigned int gen;                 // generation the decode was made at.
+	int len;                          // amount of bytes decoded.
+	char bytes[64];                   // the row's bytes.
+	const unsigned char* thingy[64];  // substitution starting at the byte, or NULL.
+	unsigned char thingy_len[64];     // key length of that substitution.
+};
+
+static struct ascii_cache_row ascii_cache[ASCII_CACHE_ROWS];
+
+// Current decode generation. Starts above zero so the zeroed cache rows
+// are invalid from the start.
+static unsigned int ascii_cache_gen = 1;
+
+/*
+ * Invalidates every cached row decode. Called on any edit of the contents
+ * and on any change to the thingy table (the cached substitution pointers
+ * point into the table's entries).
+ */
+static void ascii_cache_invalidate() {
+	ascii_cache_gen++;
+}
+
+/*
+ * Returns the decoded row starting at `start_offset', decoding it into its
+ * cache slot first unless a decode from the current generation is already
+ * there.
+ */
+static struct ascii_cache_row* ascii_cache_decode(struct editor* e, size_t start_offset) {
+	struct ascii_cache_row* row =
+		&ascii_cache[(start_offset / e->octets_per_line) % ASCII_CACHE_ROWS];
+
+	int len = e->octets_per_line;
+	if (start_offset + len > e->contents->length) {
+		len = e->contents->length - start_offset;
+	}
+
+	if (row->gen == ascii_cache_gen && row->start_offset == start_offset
+			&& row->len == len) {
+		return row;
+	}
+
+	// Copy the row plus the lookahead needed for the longest thingy key
+	// into a contiguous window, since the piece table does not guarantee
+	// the contents are adjacent in memory. Octets per line is clamped to
+	// 64 and a thingy key is at most 255 bytes, so this always fits.
+	char window[64 + 256];
+	size_t lookahead = e->octets_per_line
+		+ (e->thingies ? thingy_table_longest_key(e->thingies) : 0);
+	content_read(e->contents, start_offset, window, lookahead);
+
+	row->start_offset = start_offset;
+	row->gen = ascii_cache_gen;
+	row->len = len;
+
+	for (int i = 0; i < len; i++) {
+		row->bytes[i] = window[i];
+		row->thingy[i] = NULL;
+		row->thingy_len[i] = 0;
+
+		// Our goal: find the longest thingy that corresponds to the
+		// current characters.
+		if (e->thingies) {
+			size_t offset = start_offset + i;
+			int lk = thingy_table_longest_key(e->thingies);
+			//Make sure we don't go out of bounds here, either.
+			if (offset + lk > e->contents->length) lk = (e->contents->length - offset);
+
+			for (int k = 1; k <= lk; k++) {
+				const unsigned char* v = thingy_table_search(e->thingies, k,
+					(const unsigned char*) window + i);
+				if (v) { row->thingy[i] = v; row->thingy_len[i] = k; }
+			}
+		}
+	}
+
+	return row;
+}
+
+// Byte statistics hooks for the edit paths, defined with the rest of
+// the :stats machinery further down.
+static void editor_stats_edit(struct editor* e, size_t offset, size_t len);
+static void editor_stats_invalidate(struct editor* e);
+static void editor_stats_drop(struct editor* e);
+
+/*
+ * Drops the match index, e.g. because the search string changed.
+ */
+static void editor_matches_clear(struct editor* e) {
+	if (e->matches.valid) {
+		// Visible highlights disappear, so redraw every row.
+		e->full_redraw = true;
+	}
+	free(e->matches.offsets);
+	e->matches.offsets = NULL;
+	e->matches.count = 0;
+	e->matches.cap = 0;
+	e->matches.needle_len = 0;
+	e->matches.valid = false;
+}
+
+/*
+ * Updates the match index for an edit at `offset'. `delta' is +1 for an
+ * inserted byte, -1 for a deleted byte and 0 for a replaced byte. Match
+ * offsets after the edit shift by delta, and matches whose range covers
+ * the edited byte are dropped since their bytes changed. This keeps the
+ * index usable across edits without rescanning the file.
+ */
+static void editor_matches_edit(struct editor* e, size_t offset, int delta) {
+	if (!e->matches.valid) {
+		return;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < e->matches.count; i++) {
+		size_t m = e->matches.offsets[i];
+		if (m + e->matches.needle_len > offset && m <= offset) {
+			// The edit landed inside this match; drop it. The match
+			// may have spanned a row boundary, so redraw everything
+			// to erase its highlight.
+			e->full_redraw = true;
+			continue;
+		}
+		if (m > offset && delta != 0) {
+			m = delta > 0 ? m + 1 : m - 1;
+		}
+		e->matches.offsets[kept++] = m;
+	}
+	e->matches.count = kept;
+}
+
+/*
+ * Scans the whole contents and records the offset of every occurrence of
+ * the needle in the match index.
+ */
+static void editor_matches_build(struct editor* e, const char* needle, size_t len) {
+	editor_matches_clear(e);
+	e->matches.needle_len = len;
+
+	size_t from = 0;
+	for (;;) {
+		long long m = content_search_forward(e->contents, needle, len, from);
+		if (m < 0) {
+			break;
+		}
+		if (e->matches.count >= e->matches.cap) {
+			e->matches.cap = e->matches.cap == 0 ? 64 : e->matches.cap * 2;
+			e->matches.offsets = realloc(e->matches.offsets,
+					e->matches.cap * sizeof(size_t));
+			if (e->matches.offsets == NULL) {
+				perror("Unable to realloc match index");
+				exit(1);
+			}
+		}
+		e->matches.offsets[e->matches.count++] = m;
+		from = m + 1;
+	}
+	e->matches.valid = true;
+
+	// New highlights may appear on any visible row.
+	e->full_redraw = true;
+}
+
+/*
+ * Returns the amount of match offsets smaller than or equal to `offset'.
+ * Binary search, so n/N jumps and the ruler cost O(log n).
+ */
+static size_t editor_matches_rank(struct editor* e, size_t offset) {
+	size_t lo = 0;
+	size_t hi = e->matches.count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (e->matches.offsets[mid] <= offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Marks `len' bytes at `offset' as dirty for the incremental save path,
+ * merging with existing ranges when they touch or overlap. The ranges
+ * stay sorted and disjoint; a run of replaces walking right nearly
+ * always just extends the range it created on the previous keypress.
+ */
+static void editor_dirty_mark(struct editor* e, size_t offset, size_t len) {
+	struct dirty_set* d = &e->dirty_ranges;
+	if (!d->track) {
+		return;
+	}
+
+	size_t start = offset;
+	size_t end = offset + len;
+
+	// Binary search for the first range which ends at or after the new
+	// start; only that range and its successors can merge with it.
+	size_t lo = 0;
+	size_t hi = d->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (d->ranges[mid].end < start) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo < d->count && d->ranges[lo].start <= end) {
+		// Merge into the found range, swallowing any successors the
+		// grown range now reaches.
+		if (start < d->ranges[lo].start) {
+			d->ranges[lo].start = start;
+		}
+		if (end > d->ranges[lo].end) {
+			d->ranges[lo].end = end;
+		}
+		size_t j = lo + 1;
+		while (j < d->count && d->ranges[j].start <= d->ranges[lo].end) {
+			if (d->ranges[j].end > d->ranges[lo].end) {
+				d->ranges[lo].end = d->ranges[j].end;
+			}
+			j++;
+		}
+		if (j > lo + 1) {
+			memmove(&d->ranges[lo + 1], &d->ranges[j],
+					(d->count - j) * sizeof(struct byte_range));
+			d->count -= j - (lo + 1);
+		}
+		return;
+	}
+
+	// No overlap: insert a new range at the found position.
+	if (d->count >= d->cap) {
+		d->cap = d->cap == 0 ? 16 : d->cap * 2;
+		d->ranges = realloc(d->ranges, d->cap * sizeof(struct byte_range));
+		if (d->ranges == NULL) {
+			perror("Unable to realloc dirty ranges");
+			exit(1);
+		}
+	}
+	memmove(&d->ranges[lo + 1], &d->ranges[lo],
+			(d->count - lo) * sizeof(struct byte_range));
+	d->ranges[lo].start = start;
+	d->ranges[lo].end = end;
+	d->count++;
+}
+
+/*
+ * Empties the dirty set and resumes tracking, after a successful save.
+ */
+static void editor_dirty_reset(struct editor* e) {
+	e->dirty_ranges.count = 0;
+	e->dirty_ranges.track = true;
+}
+
+/*
+ * One worker's slice of the open-time comparison against the -d file:
+ * the two flat buffers, the half-open range to compare and the differing
+ * ranges found in it.
+ */
+struct diff_job {
+	const char* a; // the opened file's original data.
+	const char* b; // the comparison file's data.
+	size_t lo;     // first offset of the slice.
+	size_t hi;     // one past the last offset of the slice.
+
+	struct byte_range* ranges; // differing ranges found, in order.
+	size_t count;
+	size_t cap;
+};
+
+/*
+ * Appends a differing range to the job's result, extending the previous
+ * range when they touch.
+ */
+static void diff_job_push(struct diff_job* job, size_t start, size_t end) {
+	if (job->count > 0 && job->ranges[job->count - 1].end == start) {
+		job->ranges[job->count - 1].end = end;
+		return;
+	}
+	if (job->count >= job->cap) {
+		job->cap = job->cap == 0 ? 16 : job->cap * 2;
+		job->ranges = realloc(job->ranges, job->cap * sizeof(struct byte_range));
+		if (job->ranges == NULL) {
+			perror("Unable to realloc diff ranges");
+			exit(1);
+		}
+	}
+	job->ranges[job->count].start = start;
+	job->ranges[job->count].end = end;
+	job->count++;
+}
+
+/*
+ * Compares one slice of the two buffers. Equal data - the vast majority
+ * of a patched image - is skipped with one memcmp per block; only blocks
+ * that differ are scanned per byte.
+ */
+static void* editor_diff_worker(void* arg) {
+	struct diff_job* job = arg;
+
+	size_t pos = job->lo;
+	while (pos < job->hi) {
+		size_t chunk = job->hi - pos;
+		if (chunk > DIFF_BLOCK) {
+			chunk = DIFF_BLOCK;
+		}
+		if (memcmp(job->a + pos, job->b + pos, chunk) == 0) {
+			pos += chunk;
+			continue;
+		}
+		for (size_t i = 0; i < chunk; i++) {
+			if (job->a[pos + i] != job->b[pos + i]) {
+				diff_job_push(job, pos + i, pos + i + 1);
+			}
+		}
+		pos += chunk;
+	}
+	return NULL;
+}
+
+void editor_diff_build(struct editor* e, const char* filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		perror("Unable to open comparison file");
+		exit(1);
+	}
+	struct stat statbuf;
+	if (fstat(fd, &statbuf) < 0) {
+		perror("Unable to stat comparison file");
+		exit(1);
+	}
+	size_t other_len = statbuf.st_size;
+
+	char* other = NULL;
+	if (other_len > 0) {
+		other = mmap(NULL, other_len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (other == MAP_FAILED) {
+			perror("Unable to mmap comparison file");
+			exit(1);
+		}
+	}
+
+	// This runs right after opening, when the whole contents still live
+	// in the original buffer, so the comparison works over flat memory.
+	// That is also what makes the worker threads safe: nothing touches
+	// the piece table.
+	assert(e->contents->length == e->contents->orig_len);
+	size_t common = e->contents->length < other_len ? e->contents->length : other_len;
+
+	struct diff_job jobs[DIFF_THREADS];
+	memset(jobs, 0, sizeof(jobs));
+
+	int njobs = common >= DIFF_THREAD_THRESHOLD ? DIFF_THREADS : 1;
+	size_t slice = common / njobs;
+	for (int i = 0; i < njobs; i++) {
+		jobs[i].a = e->contents->orig;
+		jobs[i].b = other;
+		jobs[i].lo = i * slice;
+		jobs[i].hi = i == njobs - 1 ? common : (i + 1) * slice;
+	}
+
+	if (njobs == 1) {
+		if (common > 0) {
+			editor_diff_worker(&jobs[0]);
+		}
+	} else {
+		pthread_t threads[DIFF_THREADS];
+		for (int i = 0; i < njobs; i++) {
+			if (pthread_create(&threads[i], NULL, editor_diff_worker, &jobs[i]) != 0) {
+				perror("Unable to create diff thread");
+				exit(1);
+			}
+		}
+		for (int i = 0; i < njobs; i++) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	// Concatenate the slice results in order into one merged job, gluing
+	// ranges that touch across a slice boundary back together.
+	struct diff_job merged;
+	memset(&merged, 0, sizeof(merged));
+	for (int i = 0; i < njobs; i++) {
+		for (size_t j = 0; j < jobs[i].count; j++) {
+			diff_job_push(&merged, jobs[i].ranges[j].start, jobs[i].ranges[j].end);
+		}
+		free(jobs[i].ranges);
+	}
+
+	// Bytes past the end of the shorter file count as one differing tail.
+	if (e->contents->length > other_len) {
+		diff_job_push(&merged, other_len, e->contents->length);
+	}
+
+	e->diffs.ranges = merged.ranges;
+	e->diffs.count = merged.count;
+	e->diffs.cap = merged.cap;
+	e->diffs.valid = true;
+
+	if (other) {
+		munmap(other, other_len);
+	}
+	close(fd);
+
+	editor_statusmessage(e, STATUS_INFO, "%zu differing range(s) against \"%s\"",
+			e->diffs.count, filename);
+}
+
+/*
+ * Returns the index of the first diff range whose end is past `offset',
+ * i.e. the first range which may still cover or follow it.
+ */
+static size_t editor_diffs_rank(struct editor* e, size_t offset) {
+	size_t lo = 0;
+	size_t hi = e->diffs.count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (e->diffs.ranges[mid].end <= offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Moves the cursor to the start of the next (dir > 0) or previous
+ * (dir < 0) differing range relative to the cursor, found with a binary
+ * search on the diff index.
+ */
+static void editor_diff_jump(struct editor* e, int dir) {
+	if (!e->diffs.valid) {
+		editor_statusmessage(e, STATUS_ERROR, "No comparison file (open with -d)");
+		return;
+	}
+	if (e->diffs.count == 0) {
+		editor_statusmessage(e, STATUS_INFO, "Files are identical");
+		return;
+	}
+
+	size_t cur = editor_offset_at_cursor(e);
+
+	// Count the ranges starting at or before the cursor; the next range
+	// is right after them, the previous one right before.
+	size_t lo = 0;
+	size_t hi = e->diffs.count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (e->diffs.ranges[mid].start <= cur) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	size_t idx;
+	if (dir > 0) {
+		if (lo >= e->diffs.count) {
+			editor_statusmessage(e, STATUS_WARNING, "No further differences");
+			return;
+		}
+		idx = lo;
+	} else {
+		if (lo == 0) {
+			editor_statusmessage(e, STATUS_WARNING, "No further differences");
+			return;
+		}
+		idx = lo - 1;
+		// When the cursor already sits at the start of this range, move
+		// to the one before it.
+		if (e->diffs.ranges[idx].start == cur) {
+			if (idx == 0) {
+				editor_statusmessage(e, STATUS_WARNING, "No further differences");
+				return;
+			}
+			idx--;
+		}
+	}
+
+	editor_scroll_to_offset(e, e->diffs.ranges[idx].start);
+	editor_statusmessage(e, STATUS_INFO, "Difference %zu of %zu (offset 0x%09llx)",
+			idx + 1, e->diffs.count,
+			(unsigned long long) e->diffs.ranges[idx].start);
+}
+
 /*
  * This function looks convoluted as hell, but it works...
  */
@@ -85,8 +678,8 @@ void editor_move_cursor(struct editor* e, int dir, int amount) {
 
 	// Did we hit the end of the file somehow? Set the cursor position
 	// to the maximum cursor position possible.
-	unsigned int offset = editor_offset_at_cursor(e);
-	if (offset >= e->content_length - 1) {
+	size_t offset = editor_offset_at_cursor(e);
+	if (offset >= e->contents->length - 1) {
 		editor_cursor_at_offset(e, offset, &e->cursor_x, &e->cursor_y);
 		return;
 	}
@@ -95,11 +688,74 @@ void editor_move_cursor(struct editor* e, int dir, int amount) {
 void editor_newfile(struct editor* e, const char* filename) {
 	e->filename = malloc(strlen(filename) + 1);
 	strncpy(e->filename, filename, strlen(filename) + 1);
-	e->contents = malloc(0);
-	e->content_length = 0;
+	e->contents = content_init();
+}
+
+/*
+ * Reads a stream of unknown size (a /proc pseudo-file, a pipe) to its
+ * end, in large blocks into a geometrically growing buffer. Returns the
+ * malloc'd buffer and stores its length in `len'. Reading per block
+ * instead of per byte keeps the syscall count proportional to the block
+ * count, not to every single byte of the data.
+ */
+static char* editor_read_stream(FILE* fp, size_t* len) {
+	size_t cap = STREAM_BLOCK;
+	size_t n = 0;
+	char* buf = malloc(cap);
+	if (buf == NULL) {
+		perror("Unable to allocate stream buffer");
+		exit(1);
+	}
+
+	for (;;) {
+		if (cap - n < STREAM_BLOCK) {
+			cap *= 2;
+			buf = realloc(buf, cap);
+			if (buf == NULL) {
+				perror("Unable to realloc stream buffer");
+				exit(1);
+			}
+		}
+		size_t r = fread(buf + n, 1, STREAM_BLOCK, fp);
+		n += r;
+		if (r < STREAM_BLOCK) {
+			if (ferror(fp)) {
+				perror("Unable to read stream");
+				exit(1);
+			}
+			break;
+		}
+	}
+
+	*len = n;
+	return buf;
 }
 
 void editor_openfile(struct editor* e, const char* filename) {
+	// A filename of `-' reads standard input to EOF, so piping into the
+	// editor works (e.g. `zcat dump.gz | hx -'). The terminal is then
+	// reattached to stdin, which the key input reads from.
+	if (strcmp(filename, "-") == 0) {
+		size_t content_length = 0;
+		char* contents = editor_read_stream(stdin, &content_length);
+
+		int tty = open("/dev/tty", O_RDONLY);
+		if (tty == -1 || dup2(tty, STDIN_FILENO) == -1) {
+			perror("Unable to reattach the terminal to stdin");
+			exit(1);
+		}
+		close(tty);
+
+		e->filename = malloc(2);
+		strncpy(e->filename, "-", 2);
+		e->contents = content_from_buffer(contents, content_length);
+		// There is no on-disk file behind a pipe, so saves must always
+		// take the full-rewrite path.
+		e->contents->orig_mirrors_file = false;
+		editor_statusmessage(e, STATUS_INFO, "(stdin) (%zu bytes)", content_length);
+		return;
+	}
+
 	FILE* fp = fopen(filename, "rb");
 	if (fp == NULL) {
 		if (errno == ENOENT) {
@@ -127,28 +783,46 @@ void editor_openfile(struct editor* e, const char* filename) {
 		exit(1);
 	}
 
-	// The content buffer. When stat() returns a non-zero length, this will
-	// be malloc'd. When <= 0, this will be assigned via a charbuf. This
-	// branching is done because 1) Otherwise /proc/ cannot be read, and 2)
-	// reading a large file just with fgetc() imposes a major negative performance
-	// impact.
+	// Large files are not read into memory at all: map them read-only and
+	// let the kernel page in whatever the render path touches. Edits are
+	// no problem, since the piece table never writes to the original data.
+	if (statbuf.st_size >= MMAP_THRESHOLD || (e->prefer_mmap && statbuf.st_size > 0)) {
+		char* map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+		if (map != MAP_FAILED) {
+			// Hint the kernel we will mostly read the file front to
+			// back (scrolling), so it can read ahead aggressively.
+			madvise(map, statbuf.st_size, MADV_SEQUENTIAL);
+
+			e->filename = malloc(strlen(filename) + 1);
+			strncpy(e->filename, filename, strlen(filename) + 1);
+			e->contents = content_from_mmap(map, statbuf.st_size);
+
+			if (access(filename, W_OK) == -1) {
+				editor_statusmessage(e, STATUS_WARNING, "\"%s\" (%zu bytes) [mmap] [readonly]", e->filename, e->contents->length);
+			} else {
+				editor_statusmessage(e, STATUS_INFO, "\"%s\" (%zu bytes) [mmap]", e->filename, e->contents->length);
+			}
+
+			fclose(fp);
+			return;
+		}
+		// mmap failed (e.g. the file lives on a filesystem without
+		// mmap support); fall through to the read path below.
+	}
+
+	// The content buffer. When stat() returns a non-zero length, it is
+	// malloc'd up front and filled with one fread. When <= 0 the size is
+	// unknown (e.g. /proc/ pseudo-files), so the stream reader grows a
+	// buffer as it goes.
 	char* contents;
-	int content_length = 0;
+	size_t content_length = 0;
 
 	if (statbuf.st_size <= 0) {
 		// The stat() returned a (less than) zero size length. This may be
-		// because the user is trying to read a file from /proc/. In that
-		// case, read the data per-byte until EOF.
-		struct charbuf* buf = charbuf_create();
-		int c;
-		char tempbuf[1];
-		while ((c = fgetc(fp)) != EOF) {
-			tempbuf[0] = (char) c;
-			charbuf_append(buf, tempbuf, 1);
-		}
-		// Point contents to the charbuf's contents and set the length accordingly.
-		contents = buf->contents;
-		content_length = buf->len;
+		// because the user is trying to read a file from /proc/, where the
+		// reported size says nothing about the actual contents. Stream it
+		// to EOF in large blocks.
+		contents = editor_read_stream(fp, &content_length);
 	} else {
 		// stat() returned a size we can work with. Allocate memory for the
 		// buffer, No need for extra room for a null string terminator, since
@@ -167,58 +841,245 @@ void editor_openfile(struct editor* e, const char* filename) {
 	 // duplicate string without using gnu99 strdup().
 	e->filename = malloc(strlen(filename) + 1);
 	strncpy(e->filename, filename, strlen(filename) + 1);
-	e->contents = contents;
-	e->content_length = content_length;
+	// Hand the buffer over to the piece table, which takes ownership.
+	e->contents = content_from_buffer(contents, content_length);
 
 	// Check if the file is readonly, and warn the user about that.
 	if (access(filename, W_OK) == -1) {
-		editor_statusmessage(e, STATUS_WARNING, "\"%s\" (%d bytes) [readonly]", e->filename, e->content_length);
+		editor_statusmessage(e, STATUS_WARNING, "\"%s\" (%zu bytes) [readonly]", e->filename, e->contents->length);
 	} else {
-		editor_statusmessage(e, STATUS_INFO, "\"%s\" (%d bytes)", e->filename, e->content_length);
+		editor_statusmessage(e, STATUS_INFO, "\"%s\" (%zu bytes)", e->filename, e->contents->length);
 	}
 
 	fclose(fp);
 }
 
-void editor_writefile(struct editor* e) {
-	assert(e->filename != NULL);
+/*
+ * Redraws only the status line. Used while a worker thread owns the
+ * contents, since a full refresh would read the contents from the main
+ * thread at the same time.
+ */
+static void editor_draw_statusline(struct editor* e) {
+	struct charbuf* b = charbuf_create();
+	editor_render_status(e, b);
+	charbuf_draw(b);
+	charbuf_free(b);
+}
 
-	FILE* fp = fopen(e->filename, "wb");
-	if (fp == NULL) {
-		editor_statusmessage(e, STATUS_ERROR, "Unable to open '%s' for writing: %s", e->filename, strerror(errno));
-		return;
-	}
+/*
+ * State shared between the main thread and the save worker. The worker
+ * only writes `progress', `result' and `done'; the main thread only
+ * writes `cancel'. While the worker runs, the main thread does not touch
+ * the contents, only the status line.
+ */
+struct save_job {
+	struct content* contents;
+	int fd; // file descriptor the contents are streamed to.
 
-	size_t bw = fwrite(e->contents, sizeof(char), e->content_length, fp);
-	if (bw <= 0) {
-		editor_statusmessage(e, STATUS_ERROR, "Unable write to file: %s", strerror(errno));
-		return;
+	volatile bool   cancel;   // main thread: request the worker to stop.
+	volatile bool   done;     // worker: write finished (or cancelled).
+	volatile size_t progress; // worker: bytes written so far.
+	long long result;         // worker: bytes written, or -1 on error.
+};
+
+/*
+ * Streams the whole contents to the job's file descriptor in large
+ * chunks. Runs on a worker thread for large buffers, or inline for small
+ * ones.
+ */
+static void* editor_save_worker(void* arg) {
+	struct save_job* job = arg;
+	struct content* c = job->contents;
+
+	char* chunk = malloc(SAVE_CHUNK);
+	if (chunk == NULL) {
+		job->result = -1;
+		job->done = true;
+		return NULL;
 	}
 
-	editor_statusmessage(e, STATUS_INFO, "\"%s\", %d bytes written", e->filename, e->content_length);
-	e->dirty = false;
+	job->result = 0;
+	size_t offset = 0;
+	while (!job->cancel && job->result == 0 && offset < c->length) {
+		size_t got = content_read(c, offset, chunk, SAVE_CHUNK);
+		size_t written = 0;
+		while (written < got) {
+			ssize_t w = write(job->fd, chunk + written, got - written);
+			if (w < 0) {
+				job->result = -1;
+				break;
+			}
+			written += w;
+		}
+		offset += got;
+		job->progress = offset;
+	}
 
-	fclose(fp);
+	if (job->result == 0) {
+		job->result = (long long) offset;
+	}
+	free(chunk);
+	job->done = true;
+	return NULL;
 }
 
+void editor_writefile(struct editor* e) {
+	assert(e->filename != NULL);
 
-void editor_cursor_at_offset(struct editor* e, int offset, int* x, int* y) {
-	*x = offset % e->octets_per_line + 1;
-	*y = offset / e->octets_per_line - e->line + 1;
-}
-
+	// When the dirty-range tracking survived (pure replacements since
+	// the last save), flush only the bytes changed since then. This is
+	// even cheaper than the patch path below, which re-writes every
+	// range ever changed on each save.
+	if (e->dirty_ranges.track && content_can_patch(e->contents)) {
+		int fd = open(e->filename, O_WRONLY);
+		if (fd >= 0) {
+			char chunk[65536];
+			long long written = 0;
+			bool failed = false;
+			for (size_t i = 0; i < e->dirty_ranges.count && !failed; i++) {
+				size_t off = e->dirty_ranges.ranges[i].start;
+				size_t end = e->dirty_ranges.ranges[i].end;
+				while (off < end) {
+					size_t want = end - off;
+					if (want > sizeof(chunk)) {
+						want = sizeof(chunk);
+					}
+					content_read(e->contents, off, chunk, want);
+					if (pwrite(fd, chunk, want, (off_t) off) < (ssize_t) want) {
+						failed = true;
+						break;
+					}
+					written += want;
+					off += want;
+				}
+			}
+			close(fd);
+			if (!failed) {
+				editor_statusmessage(e, STATUS_INFO, "\"%s\", %lld of %zu bytes flushed", e->filename, written, e->contents->length);
+				e->dirty = false;
+				e->save_count++;
+				editor_dirty_reset(e);
+				return;
+			}
+			editor_statusmessage(e, STATUS_ERROR, "Unable write to file: %s", strerror(errno));
+			return;
+		}
+		// Could not open for writing; fall through to the paths below,
+		// which report the error themselves.
+	}
 
-void editor_delete_char_at_cursor(struct editor* e) {
-	unsigned int offset = editor_offset_at_cursor(e);
-	unsigned int old_length = e->content_length;
+	// When the edits were pure replacements, only patch the changed
+	// ranges in place instead of rewriting the whole file. On a large
+	// mapped image this writes a few bytes instead of gigabytes.
+	if (content_can_patch(e->contents)) {
+		FILE* pfp = fopen(e->filename, "r+b");
+		if (pfp != NULL) {
+			long long patched = content_flush_patch(e->contents, pfp);
+			fclose(pfp);
+			if (patched >= 0) {
+				editor_statusmessage(e, STATUS_INFO, "\"%s\", %lld of %zu bytes patched", e->filename, patched, e->contents->length);
+				e->dirty = false;
+				e->save_count++;
+				editor_dirty_reset(e);
+				return;
+			}
+			editor_statusmessage(e, STATUS_ERROR, "Unable write to file: %s", strerror(errno));
+			return;
+		}
+		// Could not open for updating (e.g. the file disappeared);
+		// fall through to the full rewrite below.
+	}
 
-	if (e->content_length <= 0) {
-		editor_statusmessage(e, STATUS_WARNING, "Nothing to delete");
+	// A full rewrite is unavoidable. Stream the contents to a temp file
+	// next to the original and rename it into place afterwards, so a
+	// crash or cancel mid-save cannot leave a truncated file behind.
+	size_t tmplen = strlen(e->filename) + 8;
+	char* tmppath = malloc(tmplen);
+	snprintf(tmppath, tmplen, "%s.XXXXXX", e->filename);
+	int fd = mkstemp(tmppath);
+	if (fd < 0) {
+		editor_statusmessage(e, STATUS_ERROR, "Unable to open '%s' for writing: %s", tmppath, strerror(errno));
+		free(tmppath);
 		return;
 	}
 
-	unsigned char charat = e->contents[offset];
-	editor_delete_char_at_offset(e, offset);
+	// Carry over the permissions of the original file; mkstemp creates
+	// the temp file as 0600.
+	struct stat statbuf;
+	if (stat(e->filename, &statbuf) == 0) {
+		fchmod(fd, statbuf.st_mode);
+	}
+
+	struct save_job job;
+	memset(&job, 0, sizeof(job));
+	job.contents = e->contents;
+	job.fd = fd;
+
+	if (e->contents->length >= SAVE_THREAD_THRESHOLD) {
+		// Large buffer: write on a worker thread, so the status line
+		// can show progress and ESC can cancel, instead of freezing
+		// the editor for the whole disk write.
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, editor_save_worker, &job) != 0) {
+			// Could not spawn a worker; write inline instead.
+			editor_save_worker(&job);
+		} else {
+			while (!job.done) {
+				if (key_available(100)) {
+					if (read_key() == KEY_ESC) {
+						job.cancel = true;
+					}
+				}
+				int pct = (int) (job.progress * 100 / e->contents->length);
+				editor_statusmessage(e, STATUS_INFO, "Saving... %d%% (ESC to cancel)", pct);
+				editor_draw_statusline(e);
+			}
+			pthread_join(thread, NULL);
+		}
+	} else {
+		editor_save_worker(&job);
+	}
+
+	close(fd);
+
+	if (job.cancel) {
+		unlink(tmppath);
+		free(tmppath);
+		editor_statusmessage(e, STATUS_WARNING, "Save cancelled, \"%s\" left untouched", e->filename);
+		return;
+	}
+	if (job.result < 0 || rename(tmppath, e->filename) != 0) {
+		unlink(tmppath);
+		free(tmppath);
+		editor_statusmessage(e, STATUS_ERROR, "Unable write to file: %s", strerror(errno));
+		return;
+	}
+	free(tmppath);
+
+	editor_statusmessage(e, STATUS_INFO, "\"%s\", %zu bytes written", e->filename, e->contents->length);
+	e->dirty = false;
+	e->save_count++;
+	editor_dirty_reset(e);
+}
+
+
+void editor_cursor_at_offset(struct editor* e, size_t offset, int* x, int* y) {
+	*x = offset % e->octets_per_line + 1;
+	*y = (int) ((long long) (offset / e->octets_per_line) - e->line) + 1;
+}
+
+
+void editor_delete_char_at_cursor(struct editor* e) {
+	size_t offset = editor_offset_at_cursor(e);
+	size_t old_length = e->contents->length;
+
+	if (e->contents->length <= 0) {
+		editor_statusmessage(e, STATUS_WARNING, "Nothing to delete");
+		return;
+	}
+
+	unsigned char charat = content_byte_at(e->contents, offset);
+	editor_delete_char_at_offset(e, offset);
 	e->dirty = true;
 
 	// if the deleted offset was the maximum offset, move the cursor to
@@ -229,53 +1090,66 @@ void editor_delete_char_at_cursor(struct editor* e) {
 	action_list_add(e->undo_list, ACTION_DELETE, offset, charat);
 }
 
-void editor_delete_char_at_offset(struct editor* e, unsigned int offset) {
-	// Remove an element from the contents buffer by moving memory.
-	// The character at the current offset is supposed to be removed.
-	// Take the offset + 1, until the end of the buffer. Copy that
-	// part over the offset, reallocate the contents buffer with one
-	// character in size less.
-	memmove(e->contents + offset, e->contents + offset + 1 , e->content_length - offset - 1);
-	e->contents = realloc(e->contents, e->content_length - 1);
-	e->content_length--;
-
+void editor_delete_char_at_offset(struct editor* e, size_t offset) {
+	content_delete_byte(e->contents, offset);
+	editor_matches_edit(e, offset, -1);
+	editor_stats_invalidate(e);
+	ascii_cache_invalidate();
+	// Every byte after the deleted one shifts: every row changes, and the
+	// recorded dirty ranges no longer point at the right file offsets.
+	e->full_redraw = true;
+	e->dirty_ranges.track = false;
 }
 
 void editor_increment_byte(struct editor* e, int amount) {
-	unsigned int offset = editor_offset_at_cursor(e);
-	unsigned char prev = e->contents[offset];
-	e->contents[offset] += amount;
+	size_t offset = editor_offset_at_cursor(e);
+	unsigned char prev = content_byte_at(e->contents, offset);
+	editor_replace_byte_at_offset(e, offset, prev + amount);
 
 	action_list_add(e->undo_list, ACTION_REPLACE, offset, prev);
 }
 
 
-inline int editor_offset_at_cursor(struct editor* e) {
+inline size_t editor_offset_at_cursor(struct editor* e) {
 	// Calculate the offset based on the cursors' x and y coord (which is bound
 	// between (1 .. line width) and (1 .. max screen rows). Take the current displayed
 	// line into account (which is incremented when we are paging the content).
 	// Multiply it by octets_per_line since we're effectively addressing a one dimensional
 	// array.
-	unsigned int offset = (e->cursor_y - 1 + e->line) * e->octets_per_line + (e->cursor_x - 1);
+	size_t offset = (size_t) (e->cursor_y - 1 + e->line) * e->octets_per_line + (e->cursor_x - 1);
 	// Safety measure. Since we're using the value of this function to
 	// index the content array, we must not go out of bounds.
-	if (offset <= 0) {
-		return 0;
-	}
-	if (offset >= e->content_length) {
-		return e->content_length - 1;
+	if (offset >= e->contents->length) {
+		return e->contents->length == 0 ? 0 : e->contents->length - 1;
 	}
 	return offset;
 }
 
+/*
+ * Returns the selected range as [start, end) while in select mode. The
+ * selection runs between the anchor set when the mode was entered and
+ * the current cursor offset, in either order; both ends are included.
+ */
+static void editor_selection(struct editor* e, size_t* start, size_t* end) {
+	size_t cur = editor_offset_at_cursor(e);
+	if (cur < e->sel_anchor) {
+		*start = cur;
+		*end = e->sel_anchor + 1;
+	} else {
+		*start = e->sel_anchor;
+		*end = cur + 1;
+	}
+}
+
 
-void editor_scroll(struct editor* e, int units) {
+void editor_scroll(struct editor* e, long long units) {
+	long long line_before = e->line;
 	e->line += units;
 
 	// If we wanted to scroll past the end of the file, calculate the line
 	// properly. Subtract the amount of screen rows (minus 2??) to prevent
 	// scrolling past the end of file.
-	int upper_limit = e->content_length / e->octets_per_line - (e->screen_rows - 2);
+	long long upper_limit = (long long) (e->contents->length / e->octets_per_line) - (e->screen_rows - 2);
 	if (e->line >= upper_limit) {
 		e->line = upper_limit;
 	}
@@ -289,11 +1163,18 @@ void editor_scroll(struct editor* e, int units) {
 	if (e->line <= 0) {
 		e->line = 0;
 	}
+
+	// Every visible row shows different bytes now, so the whole screen
+	// has to be redrawn.
+	if (e->line != line_before) {
+		e->full_redraw = true;
+	}
 }
 
-void editor_scroll_to_offset(struct editor* e, unsigned int offset) {
-	if (offset > e->content_length) {
-		editor_statusmessage(e, STATUS_ERROR, "Out of range: 0x%09x (%u)", offset, offset);
+void editor_scroll_to_offset(struct editor* e, size_t offset) {
+	if (offset > e->contents->length) {
+		editor_statusmessage(e, STATUS_ERROR, "Out of range: 0x%09llx (%llu)",
+				(unsigned long long) offset, (unsigned long long) offset);
 		return;
 	}
 
@@ -301,8 +1182,8 @@ void editor_scroll_to_offset(struct editor* e, unsigned int offset) {
 	// Calculate the minimum offset visible, and the maximum. If
 	// the requested offset is within that range, do not update
 	// the e->line yet (i.e. do not scroll).
-	unsigned int offset_min = e->line * e->octets_per_line;
-	unsigned int offset_max = offset_min + (e->screen_rows * e->octets_per_line);
+	size_t offset_min = e->line * e->octets_per_line;
+	size_t offset_max = offset_min + (e->screen_rows * e->octets_per_line);
 
 	if (offset >= offset_min && offset <= offset_max) {
 		// We're within range! Update the cursor position, but
@@ -319,7 +1200,7 @@ void editor_scroll_to_offset(struct editor* e, unsigned int offset) {
 
 	// TODO: editor_scroll uses this same limit. Probably better to refactor
 	// this part on way or another to prevent dupe.
-	int upper_limit = e->content_length / e->octets_per_line - (e->screen_rows - 2);
+	long long upper_limit = (long long) (e->contents->length / e->octets_per_line) - (e->screen_rows - 2);
 	if (e->line >= upper_limit) {
 		e->line = upper_limit;
 	}
@@ -328,10 +1209,18 @@ void editor_scroll_to_offset(struct editor* e, unsigned int offset) {
 		e->line = 0;
 	}
 
+	// We scrolled, so the whole screen shows different bytes now.
+	e->full_redraw = true;
+
 	editor_cursor_at_offset(e, offset, &(e->cursor_x), &(e->cursor_y));
 }
 
 void editor_setmode(struct editor* e, enum editor_mode mode) {
+	// The selection highlight can span many rows; entering or leaving
+	// select mode has to repaint all of them.
+	if ((e->mode ^ mode) & MODE_SELECT) {
+		e->full_redraw = true;
+	}
 	e->mode = mode;
 	switch (e->mode) {
 	case MODE_NORMAL:        editor_statusmessage(e, STATUS_INFO, ""); break;
@@ -341,6 +1230,7 @@ void editor_setmode(struct editor* e, enum editor_mode mode) {
 	case MODE_INSERT:        editor_statusmessage(e, STATUS_INFO, "-- INSERT --"); break;
 	case MODE_INSERT_ASCII:  editor_statusmessage(e, STATUS_INFO, "-- INSERT ASCII --"); break;
 	case MODE_REPLACE:       editor_statusmessage(e, STATUS_INFO, "-- REPLACE --"); break;
+	case MODE_SELECT:        editor_statusmessage(e, STATUS_INFO, "-- SELECT --"); break;
 	case MODE_COMMAND: break;
 	case MODE_SEARCH:  break;
 	}
@@ -358,210 +1248,314 @@ int editor_statusmessage(struct editor* e, enum status_severity sev, const char*
 	return x;
 }
 
-void editor_render_ascii(struct editor* e, int rownum, unsigned int start_offset, struct charbuf* b) {
+void editor_render_ascii(struct editor* e, int rownum, size_t start_offset, struct charbuf* b) {
 	int cc = 0; // cursor counter, to check whether we should highlight the current offset.
 
-	for (unsigned int offset = start_offset; offset < start_offset + e->octets_per_line; offset++) {
-		// Make sure we do not go out of bounds.
-		if (offset >= e->content_length) {
-			return;
-		}
+	if (!render_tables_ready) {
+		render_tables_init();
+	}
 
-		char c =  e->contents[offset];
+	// Chars sharing the same color are collected in `run' and appended in
+	// one go, so a row is a handful of appends instead of one per char.
+	// The octets per line are clamped to 64, so this always fits.
+	char run[64];
+	int runlen = 0;
+	int prev_attr = -1; // color the terminal is set to: -1 forces the first emit.
+
+	// The bytes and the thingy substitutions come from the row cache; only
+	// the cursor highlight is applied fresh, since it changes every frame
+	// without the decode changing.
+	struct ascii_cache_row* row = ascii_cache_decode(e, start_offset);
+
+	// The visual selection, like the cursor, is a per-frame highlight on
+	// top of the cached decode.
+	size_t sel_start = 0;
+	size_t sel_end = 0; // exclusive; empty unless in select mode.
+	if (e->mode & MODE_SELECT) {
+		editor_selection(e, &sel_start, &sel_end);
+	}
 
-		int thingy_length = 0;
-		const unsigned char* thingy = NULL;
-		// Our goal: find the longest thingy that corresponds to the current characters
-		if (e->thingies) {
-			int lk = thingy_table_longest_key(e->thingies);
-			//Make sure we don't do out of bounds here, either.
-			if (offset + lk > e->content_length) lk = (e->content_length - offset); 
+	for (int i = 0; i < row->len; i++) {
+		char c = row->bytes[i];
+		const unsigned char* thingy = row->thingy[i];
+		int thingy_length = row->thingy_len[i];
 
-			for (int i=1; i <= lk; i++) {
-				const unsigned char* v = thingy_table_search(e->thingies,i,
-					(const unsigned char*) e->contents + offset);
-				if (v) { thingy = v; thingy_length = i; }
-			}
-		}
-		
 		cc+= (thingy ? thingy_length : 1);
 
+		size_t offset = start_offset + i;
+		bool selected = offset >= sel_start && offset < sel_end;
+
 		bool hilight = false;
 		if (thingy) {
 			hilight = (rownum == e->cursor_y && cc >= e->cursor_x && cc < (e->cursor_x + thingy_length) );
 		} else {
 			hilight = (rownum == e->cursor_y && cc == e->cursor_x);
 		}
-
-		// If we need to highlight the cursor in the current iteration,
-		// do so by inverting the color (7m). In all other cases, reset (0m).
-		if (hilight) {
-			charbuf_append(b, "\x1b[7m", 4);
-		} else {
-			charbuf_append(b, "\x1b[0m", 4);
+		// Selected thingies invert like the cursor does; their own color
+		// escapes leave no room for a background of their own.
+		if (thingy && selected) {
+			hilight = true;
 		}
 
 		if (thingy) {
-
-			if ((int)((offset + thingy_length) - start_offset) > (e->octets_per_line)) {
+			// Thingies change color per occurrence, so flush the
+			// pending run and emit their escapes directly.
+			render_flush_run(b, run, &runlen);
+			// If we need to highlight the cursor, do so by inverting
+			// the color (7m). In all other cases, reset (0m).
+			charbuf_append(b, hilight ? "\x1b[0m\x1b[7m" : "\x1b[0m", hilight ? 8 : 4);
+			if (i + thingy_length > e->octets_per_line) {
 				charbuf_appendf(b, "\x1b[33m%s", (const char*) thingy);
 				//the different color indicates that the thingy goes past this line
 			} else {
 				charbuf_appendf(b, "\x1b[32m%s", (const char*) thingy);
 			}
-			offset += (thingy_length - 1);
-		} else {
-			// Printable characters use a different color from non-printable characters.
-			if (isprint(c)) {
-				charbuf_appendf(b, "\x1b[37m%c", c);
-			} else {
-				charbuf_append(b, "\x1b[36m.", 6);
+			prev_attr = -1;
+			i += (thingy_length - 1);
+			continue;
+		}
+
+		// Printable characters use a different color from non-printable
+		// characters; the cursor inverts the color on top of that. Only
+		// emit the escapes when the color differs from the previous
+		// char, collapsing the per-char resets into one per run.
+		int attr = (isprint(c) ? ATTR_PRINT : 0) | (hilight ? ATTR_CURSOR : 0)
+				| (selected ? ATTR_SELECT : 0);
+		if (attr != prev_attr) {
+			render_flush_run(b, run, &runlen);
+			charbuf_append(b, "\x1b[0m", 4);
+			charbuf_append(b, (attr & ATTR_PRINT) ? "\x1b[37m" : "\x1b[36m", 5);
+			if (attr & ATTR_CURSOR) {
+				charbuf_append(b, "\x1b[7m", 4);
 			}
+			if (attr & ATTR_SELECT) {
+				charbuf_append(b, "\x1b[44m", 5);
+			}
+			prev_attr = attr;
 		}
+		run[runlen++] = asc_table[(unsigned char) c];
 	}
+	render_flush_run(b, run, &runlen);
 	// Clear formatting, erase until the end of the line: \x1b[K
 	charbuf_append(b, "\x1b[0m\x1b[K", 7);
 }
 
-void editor_render_contents(struct editor* e, struct charbuf* b) {
-	if (e->content_length <= 0) {
-		charbuf_append(b, "\x1b[2J", 4);
-		charbuf_appendf(b, "File is empty. Use 'i' to insert a hexadecimal value.");
+void editor_render_row(struct editor* e, int rownum, struct charbuf* b) {
+	size_t start_offset = (size_t) (e->line + rownum - 1) * e->octets_per_line;
+	if (start_offset >= e->contents->length) {
+		// Past the end of the file. Clear whatever was on this row, so
+		// stale rows do not linger after the file shrinks.
+		charbuf_appendf(b, "\x1b[%d;1H\x1b[2K", rownum);
 		return;
 	}
 
-	// FIXME: proper sizing of these arrays (malloc?)
-	char hex[ 32 + 1];  // example: 65
-	int  hexlen = 0;    // assigned by snprintf - we need to know the amount of chars written.
-	char asc[256 + 1];  // example: Hello.World!
+	size_t end_offset = start_offset + e->octets_per_line;
+	if (end_offset > e->contents->length) {
+		end_offset = e->contents->length;
+	}
+
+	// Position the cursor at the start of the row, and write the offset
+	// address of the row in hex.
+	charbuf_appendf(b, "\x1b[%d;1H", rownum);
+	charbuf_appendf(b, "\x1b[1;35m%09llx\x1b[0m:", (unsigned long long) start_offset);
+
+	if (!render_tables_ready) {
+		render_tables_init();
+	}
 
+	// Hex chars (and group separators) sharing the same color are
+	// collected in `run' and appended in one go, instead of an append
+	// and a reset escape per byte. Octets per line is clamped to 64,
+	// so the run always fits.
+	char run[64 * 2 + 64];
+	int runlen = 0;
+	int prev_attr = 0; // color the terminal is set to; the row starts reset.
 
 	// Counter to indicate how many chars have been written for the current
 	// row of data. This is used for later for padding, when the iteration
 	// is over, but there's still some ASCII to write.
 	int row_char_count = 0;
 
-	// start_offset is to determine where we should start reading from
-	// the buffer. This is dependent on where the cursor is, and on the
-	// octets which are visible per line.
-	unsigned int start_offset = e->line * e->octets_per_line;
-	if (start_offset >= e->content_length) {
-		start_offset = e->content_length - e->octets_per_line;
+	// Read the row's bytes through an iterator, so we pay the piece
+	// table lookup once per row instead of once per byte.
+	struct content_iter it;
+	content_iter_init(&it, e->contents, start_offset);
+
+	// Index of the first match which may still cover the current offset,
+	// used to highlight every visible occurrence of the search string.
+	size_t match_idx = 0;
+	if (e->matches.valid && e->matches.count > 0) {
+		match_idx = editor_matches_rank(e, start_offset);
+		// The rank counts matches starting at or before start_offset;
+		// the one right before may still overlap it.
+		if (match_idx > 0) {
+			match_idx--;
+		}
 	}
 
-	// Determine the end offset for displaying. There is only so much
-	// to be displayed 'per screen'. I.e. if you can only display 1024
-	// bytes, you only have to read a maximum of 1024 bytes.
-	int bytes_per_screen = e->screen_rows * e->octets_per_line;
-	unsigned int end_offset = bytes_per_screen + start_offset - e->octets_per_line;
-	if (end_offset > e->content_length) {
-		end_offset = e->content_length;
+	// Likewise for the diff index: the first differing range which may
+	// still cover the current offset.
+	size_t diff_idx = 0;
+	if (e->diffs.valid && e->diffs.count > 0) {
+		diff_idx = editor_diffs_rank(e, start_offset);
 	}
 
-	unsigned int offset;
+	// The visual selection, when active.
+	size_t sel_start = 0;
+	size_t sel_end = 0; // exclusive; empty unless in select mode.
+	if (e->mode & MODE_SELECT) {
+		editor_selection(e, &sel_start, &sel_end);
+	}
 
-	int row = 0; // Row counter, from 0 to term height
 	int col = 0; // Col counter, from 0 to number of octets per line. Used to render
 	             // a colored cursor per byte.
 
-	for (offset = start_offset; offset < end_offset; offset++) {
-		unsigned char curr_byte = e->contents[offset];
-
-		if (offset % e->octets_per_line == 0) {
-			// start of a new row, beginning with an offset address in hex.
-			charbuf_appendf(b, "\x1b[1;35m%09x\x1b[0m:", offset);
-			// Initialize the ascii buffer to all zeroes, and reset the row char count.
-			memset(asc, '\0', sizeof(asc));
-			row_char_count = 0;
-			col = 0;
-			row++;
-		}
+	for (size_t offset = start_offset; offset < end_offset; offset++) {
+		unsigned char curr_byte = content_iter_next(&it);
 		col++;
 
-		// Format a hex string of the current character in the offset.
-		if (isprint(curr_byte)) {
-			// If the character is printable, use a different color.
-			hexlen = snprintf(hex, sizeof(hex), "\x1b[1;34m%02x", curr_byte);
-		} else {
-			// Non printable: use default color.
-			hexlen = snprintf(hex, sizeof(hex), "%02x", curr_byte);
+		// The color this byte renders in: printable bytes get a bright
+		// blue foreground, the byte under the cursor inverts (easier
+		// to distinguish in the army of hexadecimal values), bytes
+		// which are part of a search match get a yellow background and
+		// bytes differing from the -d comparison file a red one.
+		int attr = isprint(curr_byte) ? ATTR_PRINT : 0;
+		if (e->cursor_y == rownum && e->cursor_x == col) {
+			attr |= ATTR_CURSOR;
 		}
-
-		// Every iteration, set the ascii value in the buffer, until
-		// 16 bytes are set. This will be written later when the hex
-		// values are drawn to screen.
-		if (isprint(curr_byte)) {
-			asc[offset % e->octets_per_line] = curr_byte;
-		} else {
-			// non-printable characters are represented by a dot.
-			asc[offset % e->octets_per_line] = '.';
+		if (e->matches.valid) {
+			while (match_idx < e->matches.count
+					&& e->matches.offsets[match_idx] + e->matches.needle_len <= offset) {
+				match_idx++;
+			}
+			if (match_idx < e->matches.count && e->matches.offsets[match_idx] <= offset) {
+				attr |= ATTR_MATCH;
+			}
+		}
+		if (e->diffs.valid) {
+			while (diff_idx < e->diffs.count
+					&& e->diffs.ranges[diff_idx].end <= offset) {
+				diff_idx++;
+			}
+			if (diff_idx < e->diffs.count && e->diffs.ranges[diff_idx].start <= offset) {
+				attr |= ATTR_DIFF;
+			}
+		}
+		if (offset >= sel_start && offset < sel_end) {
+			attr |= ATTR_SELECT;
 		}
 
-		// Every 'group' count, write a separator space.
+		// Every 'group' count, write a separator space. The space only
+		// shows its background, so a highlight must not bleed into it.
 		if (offset % e->grouping == 0) {
-			charbuf_append(b, " ", 1);
+			if (prev_attr & (ATTR_CURSOR | ATTR_MATCH | ATTR_DIFF | ATTR_SELECT)) {
+				render_flush_run(b, run, &runlen);
+				charbuf_append(b, "\x1b[0m", 4);
+				prev_attr = 0;
+			}
+			run[runlen++] = ' ';
 			row_char_count++;
 		}
 
-		// Cursor rendering.
-		if (e->cursor_y == row) {
-			// Render the selected byte with a different color. Easier
-			// to distinguish in the army of hexadecimal values.
-			if (e->cursor_x == col) {
+		// Only emit escapes when the color differs from the previous
+		// byte, collapsing the per-byte resets into one per run.
+		if (attr != prev_attr) {
+			render_flush_run(b, run, &runlen);
+			charbuf_append(b, "\x1b[0m", 4);
+			if (attr & ATTR_PRINT) {
+				charbuf_append(b, "\x1b[1;34m", 7);
+			}
+			if (attr & ATTR_CURSOR) {
 				charbuf_append(b, "\x1b[7m", 4);
 			}
+			if (attr & ATTR_MATCH) {
+				charbuf_append(b, "\x1b[43m", 5);
+			}
+			if (attr & ATTR_DIFF) {
+				charbuf_append(b, "\x1b[41m", 5);
+			}
+			if (attr & ATTR_SELECT) {
+				charbuf_append(b, "\x1b[44m", 5);
+			}
+			prev_attr = attr;
 		}
-		// Write the hex value of the byte at the current offset, and reset attributes.
-		charbuf_append(b, hex, hexlen);
-		charbuf_append(b, "\x1b[0m", 4);
 
+		run[runlen++] = hex_table[curr_byte][0];
+		run[runlen++] = hex_table[curr_byte][1];
 		row_char_count += 2;
-
-		// If we reached the end of a 'row', start writing the ASCII equivalents.
-		if ((offset+1) % e->octets_per_line == 0) {
-			// Two spaces "gap" between the hexadecimal display, and the ASCII equiv.
-			charbuf_append(b, "  ", 2);
-			// Calculate the 'start offset' of the ASCII part to write. Delegate
-			// this to the render_ascii function.
-			int the_offset = offset + 1 - e->octets_per_line;
-			editor_render_ascii(e, row, the_offset, b);
-			charbuf_append(b, "\r\n", 2);
-		}
-	}
-
-	// Check remainder of the last offset. If its bigger than zero,
-	// we got a last line to write (ASCII only).
-	unsigned int leftover = offset % e->octets_per_line;
-	if (leftover > 0) {
-		// Padding characters, to align the ASCII properly. For example, this
-		// could be the output at the end of the file:
-		// 000000420: 0a53 4f46 5457 4152 452e 0a              .SOFTWARE..
-		//                                       ^^^^^^^^^^^^
-		//                                       padding chars
-		int padding_size = (e->octets_per_line * 2) + (e->octets_per_line / e->grouping) - row_char_count;
+	}
+	render_flush_run(b, run, &runlen);
+	charbuf_append(b, "\x1b[0m", 4);
+
+	// When the row is only partially filled (the last row of the file),
+	// pad up to where the ASCII equivalents start. For example, this
+	// could be the output at the end of the file:
+	// 000000420: 0a53 4f46 5457 4152 452e 0a              .SOFTWARE..
+	//                                       ^^^^^^^^^^^^
+	//                                       padding chars
+	int padding_size = (e->octets_per_line * 2) + (e->octets_per_line / e->grouping) - row_char_count;
+	if (padding_size > 0) {
 		char* padding = malloc(padding_size * sizeof(char));
 		memset(padding, ' ', padding_size);
 		charbuf_append(b, padding, padding_size);
-		charbuf_append(b, "\x1b[0m  ", 6);
-		// render cursor on the ascii when applicable.
-		editor_render_ascii(e, row, offset - leftover, b);
 		free(padding);
 	}
 
-	// clear everything up until the end
-	charbuf_append(b, "\x1b[0K", 4);
+	// Two spaces "gap" between the hexadecimal display, and the ASCII equiv.
+	charbuf_append(b, "\x1b[0m  ", 6);
+	editor_render_ascii(e, rownum, start_offset, b);
+
+	// The entropy sparkline column (:stats): one char per row showing how
+	// random the block the row lives in is, so compressed or encrypted
+	// regions stand out while scrolling. Placed at a fixed column, past
+	// where the ASCII pane ends.
+	if (e->stats.enabled && e->stats.valid) {
+		size_t bi = start_offset / STATS_BLOCK;
+		if (bi < e->stats.block_count) {
+			unsigned char level = e->stats.entropy[bi];
+			// Ten steps from blank (0 bits) to dense (8 bits).
+			static const char ramp[] = " .:-=+*#%@";
+			char c = ramp[level * (sizeof(ramp) - 2) / 255];
+			// Random-looking blocks in red, structured ones in cyan.
+			const char* color = level >= (unsigned char) (7.5 * 255.0 / 8.0)
+				? "\x1b[1;31m" : "\x1b[36m";
+			int col = 10 + e->octets_per_line * 3
+				+ e->octets_per_line / e->grouping + 5;
+			charbuf_appendf(b, "\x1b[%d;%dH%s%c\x1b[0m", rownum, col, color, c);
+		}
+	}
+}
+
+void editor_render_contents(struct editor* e, struct charbuf* b) {
+	if (e->contents->length <= 0) {
+		charbuf_append(b, "\x1b[2J", 4);
+		charbuf_appendf(b, "File is empty. Use 'i' to insert a hexadecimal value.");
+		return;
+	}
+
+	// The last screen row is reserved for the status line and the ruler,
+	// so the contents occupy the rows before it.
+	for (int row = 1; row < e->screen_rows; row++) {
+		editor_render_row(e, row, b);
+	}
 
 #ifndef NDEBUG
+	size_t start_offset = e->line * e->octets_per_line;
+	size_t end_offset = start_offset + (size_t) (e->screen_rows - 1) * e->octets_per_line;
+	if (end_offset > e->contents->length) {
+		end_offset = e->contents->length;
+	}
 	charbuf_appendf(b, "\x1b[0m\x1b[1;35m\x1b[1;80HRows: %d", e->screen_rows);
-	charbuf_appendf(b, "\x1b[0K\x1b[2;80HOffset: %09x - %09x", start_offset, end_offset);
+	charbuf_appendf(b, "\x1b[0K\x1b[2;80HOffset: %09llx - %09llx",
+			(unsigned long long) start_offset, (unsigned long long) end_offset);
 	charbuf_appendf(b, "\x1b[0K\x1b[3;80H(y,x)=(%d,%d)", e->cursor_y, e->cursor_x);
-	unsigned int curr_offset = editor_offset_at_cursor(e);
-	charbuf_appendf(b, "\x1b[0K\x1b[5;80H\x1b[0KLine: %d, cursor offset: %d (hex: %02x)", e->line, curr_offset, (unsigned char) e->contents[curr_offset]);
+	size_t curr_offset = editor_offset_at_cursor(e);
+	charbuf_appendf(b, "\x1b[0K\x1b[5;80H\x1b[0KLine: %lld, cursor offset: %llu (hex: %02x)", e->line,
+			(unsigned long long) curr_offset, (unsigned char) content_byte_at(e->contents, curr_offset));
 #endif
 }
 
 void editor_render_help(struct editor* e) {
-	(void) e;
 	struct charbuf* b = charbuf_create();
 	clear_screen();
 	charbuf_append(b, "\x1b[?25l", 6); // hide cursor
@@ -583,6 +1577,8 @@ void editor_render_help(struct editor* e) {
 		"N       : Search for previous occurrence.\r\n"
 		"u       : Undo the last action.\r\n"
 		"CTRL+R  : Redo the last undone action.\r\n"
+		"d       : Move to next difference (when opened with -d).\r\n"
+		"D       : Move to previous difference (when opened with -d).\r\n"
 		"\r\n");
 	charbuf_appendf(b,
 		"a       : Append mode. Appends a byte after the current cursor position.\r\n"
@@ -591,6 +1587,8 @@ void editor_render_help(struct editor* e) {
 		"I       : Insert mode. Inserts the literal typed keys (except ESC).\r\n"
 		"r       : Replace mode. Replaces the byte at the current cursor position.\r\n"
 		"R       : Replace mode. Replaces the literal typed keys (except ESC).\r\n"
+		"v       : Select mode. Move to span a range, then d/x, f, z or y.\r\n"
+		"p / P   : Put (insert) the last yanked range after / at the cursor.\r\n"
 		":       : Command mode. Commands can be typed and executed.\r\n"
 		"ESC     : Return to normal mode.\r\n"
 		"]       : Increment byte at cursor position with 1.\r\n"
@@ -606,23 +1604,65 @@ void editor_render_help(struct editor* e) {
 
 	read_key();
 	clear_screen();
+
+	// The help screen wiped the contents, so redraw everything.
+	e->full_redraw = true;
+}
+
+
+
+static int perf_cmp_ns(const void* a, const void* b) {
+	long long x = *(const long long*) a;
+	long long y = *(const long long*) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Returns the pct'th percentile over the filled part of a timing ring.
+ */
+static long long perf_percentile(const long long* ring, size_t count, int pct) {
+	long long sorted[PERF_FRAMES];
+	memcpy(sorted, ring, count * sizeof(long long));
+	qsort(sorted, count, sizeof(long long), perf_cmp_ns);
+	return sorted[(count - 1) * pct / 100];
 }
 
+void editor_render_perf(struct editor* e, struct charbuf* b) {
+	if (e->perf.count == 0) {
+		return;
+	}
+
+	char perfmsg[120];
+	char buf[20]; // buffer for the cursor positioning
+
+	int pmbw = snprintf(perfmsg, sizeof(perfmsg),
+			"render %.2f/%.2f draw %.2f/%.2f input %.2f ms (p50/p99)  rss %lldM cb %zuK",
+			perf_percentile(e->perf.render_ns, e->perf.count, 50) / 1e6,
+			perf_percentile(e->perf.render_ns, e->perf.count, 99) / 1e6,
+			perf_percentile(e->perf.draw_ns, e->perf.count, 50) / 1e6,
+			perf_percentile(e->perf.draw_ns, e->perf.count, 99) / 1e6,
+			e->perf.input_ns / 1e6,
+			get_rss_bytes() / (1024 * 1024),
+			charbuf_high_water() / 1024);
+	int cpbw = snprintf(buf, sizeof(buf), "\x1b[0m\x1b[%d;%dH", e->screen_rows, e->screen_cols - pmbw);
 
+	charbuf_append(b, buf, cpbw);
+	charbuf_append(b, perfmsg, pmbw);
+}
 
 void editor_render_ruler(struct editor* e, struct charbuf* b) {
 	// Nothing to see. No address, no byte, no percentage. It's all a plain
 	// dark void right now. Oblivion. No data to see here, move along.
-	if (e->content_length <= 0) {
+	if (e->contents->length <= 0) {
 		return;
 	}
 
 	char rulermsg[80]; // buffer for the actual message.
 	char buf[20];      // buffer for the cursor positioning
 
-	unsigned int offset_at_cursor = editor_offset_at_cursor(e);
-	unsigned char val = e->contents[offset_at_cursor];
-	int percentage = (float)(offset_at_cursor + 1) / (float)e->content_length * 100;
+	size_t offset_at_cursor = editor_offset_at_cursor(e);
+	unsigned char val = content_byte_at(e->contents, offset_at_cursor);
+	int percentage = (float)(offset_at_cursor + 1) / (float)e->contents->length * 100;
 
 	// TODO: move cursor down etc to remain independent on the previous cursor
 	// movement in refresh_screen().
@@ -630,9 +1670,19 @@ void editor_render_ruler(struct editor* e, struct charbuf* b) {
 	// Create a ruler string. We need to calculate the amount of bytes
 	// we've actually written, to subtract that from the screen_cols to
 	// align the string properly.
+	// When a match index is available, prefix the ruler with which match
+	// the cursor is at, like "match 12/340".
+	char matchmsg[40] = {0};
+	if (e->matches.valid && e->matches.count > 0) {
+		snprintf(matchmsg, sizeof(matchmsg), "match %zu/%zu  ",
+				editor_matches_rank(e, offset_at_cursor),
+				e->matches.count);
+	}
+
 	int rmbw = snprintf(rulermsg, sizeof(rulermsg),
-			"0x%09x,%d (%02x)  %d%%",
-			offset_at_cursor, offset_at_cursor, val, percentage);
+			"%s0x%09llx,%llu (%02x)  %d%%", matchmsg,
+			(unsigned long long) offset_at_cursor,
+			(unsigned long long) offset_at_cursor, val, percentage);
 	// Create a string for the buffer to position the cursor.
 	int cpbw = snprintf(buf, sizeof(buf), "\x1b[0m\x1b[%d;%dH", e->screen_rows, e->screen_cols - rmbw);
 
@@ -669,7 +1719,22 @@ void editor_render_status(struct editor* e, struct charbuf* b) {
 
 
 void editor_refresh_screen(struct editor* e) {
-	struct charbuf* b = charbuf_create();
+	// One frame buffer for the lifetime of the process. It is reset per
+	// refresh instead of created and freed, so after the first few frames
+	// it is sized to a full screen and refreshing no longer touches the
+	// allocator at all.
+	static struct charbuf* b = NULL;
+	if (b == NULL) {
+		b = charbuf_create();
+	}
+	charbuf_reset(b);
+
+	// Timestamp the phases of this frame for the performance HUD: the
+	// assembly of the frame buffer and the write to the terminal.
+	long long t_start = e->perf.enabled ? time_ns() : 0;
+
+	// Rough upper bound per screen cell, including the color escapes.
+	charbuf_reserve(b, (size_t) e->screen_rows * e->screen_cols * 8);
 
 	charbuf_append(b, "\x1b[?25l", 6);
 	charbuf_append(b, "\x1b[H", 3); // move the cursor top left
@@ -681,13 +1746,40 @@ void editor_refresh_screen(struct editor* e) {
 			 MODE_APPEND_ASCII |
 			 MODE_REPLACE_ASCII |
 			 MODE_INSERT |
-			 MODE_INSERT_ASCII)) {
+			 MODE_INSERT_ASCII |
+			 MODE_SELECT)) {
+
+		if (e->full_redraw || e->contents->length <= 0) {
+			editor_render_contents(e, b);
+			e->full_redraw = false;
+		} else {
+			// Only the rows the cursor touched (and at most one
+			// edited row) changed since the previous refresh, so
+			// re-emit just those instead of rebuilding the whole
+			// screen. This keeps cursor movement snappy on slow
+			// terminals and wide windows.
+			if (e->prev_cursor_y != e->cursor_y) {
+				editor_render_row(e, e->prev_cursor_y, b);
+			}
+			if (e->dirty_row > 0 && e->dirty_row < e->screen_rows
+					&& e->dirty_row != e->cursor_y
+					&& e->dirty_row != e->prev_cursor_y) {
+				editor_render_row(e, e->dirty_row, b);
+			}
+			editor_render_row(e, e->cursor_y, b);
+		}
+		e->prev_cursor_y = e->cursor_y;
+		e->dirty_row = 0;
 
-		editor_render_contents(e, b);
 		editor_render_status(e, b);
 
-		// Ruler: move to the right of the screen etc.
-		editor_render_ruler(e, b);
+		// Ruler: move to the right of the screen etc. The performance
+		// HUD takes its place while enabled.
+		if (e->perf.enabled) {
+			editor_render_perf(e, b);
+		} else {
+			editor_render_ruler(e, b);
+		}
 	} else if (e->mode & MODE_COMMAND) {
 		// When in command mode, handle rendering different. For instance,
 		// the cursor is placed at the bottom. Ruler is not required.
@@ -709,63 +1801,1174 @@ void editor_refresh_screen(struct editor* e) {
 		charbuf_append(b, e->inputbuffer, e->inputbuffer_index);
 	}
 
-	charbuf_draw(b);
-	charbuf_free(b);
+	long long t_render = e->perf.enabled ? time_ns() : 0;
+
+	charbuf_draw(b);
+
+	if (e->perf.enabled) {
+		e->perf.render_ns[e->perf.pos] = t_render - t_start;
+		e->perf.draw_ns[e->perf.pos] = time_ns() - t_render;
+		e->perf.pos = (e->perf.pos + 1) % PERF_FRAMES;
+		if (e->perf.count < PERF_FRAMES) {
+			e->perf.count++;
+		}
+	}
+}
+
+
+void editor_insert_byte(struct editor* e, char x, bool after) {
+	size_t offset = editor_offset_at_cursor(e);
+	editor_insert_byte_at_offset(e, offset, x, after);
+
+	if (after) {
+		action_list_add(e->undo_list, ACTION_APPEND, offset, x);
+	} else {
+		action_list_add(e->undo_list, ACTION_INSERT, offset, x);
+	}
+}
+
+// Defined with the other span helpers further down.
+static void editor_insert_span_at_offset(struct editor* e, size_t offset,
+		const unsigned char* bytes, size_t len);
+static void editor_delete_span_at_offset(struct editor* e, size_t offset, size_t len);
+static void editor_fill_span_at_offset(struct editor* e, size_t offset, size_t len, char x);
+
+/*
+ * Inserts `len' bytes at the cursor in one go: one splice of the contents
+ * and one (coalesced) undo record, instead of a piece split and an action
+ * per byte. Used when a paste delivers a whole batch of input at once.
+ */
+static void editor_insert_bytes(struct editor* e, const char* buf, size_t len, bool after) {
+	size_t offset = editor_offset_at_cursor(e);
+	size_t insert_offset = offset;
+	if (after && e->contents->length) { // append is the same as insert when buffer is empty
+		insert_offset++;
+	}
+
+	editor_insert_span_at_offset(e, insert_offset, (const unsigned char*) buf, len);
+
+	// Recorded per byte at consecutive offsets, exactly as consecutive
+	// keystrokes would be, so the records coalesce into one span action.
+	for (size_t i = 0; i < len; i++) {
+		action_list_add(e->undo_list, after ? ACTION_APPEND : ACTION_INSERT,
+				offset + i, (unsigned char) buf[i]);
+	}
+}
+
+void editor_insert_byte_at_offset(struct editor* e, size_t offset, char x, bool after) {
+	if (after && e->contents->length) { // append is the same as insert when buffer is empty
+		offset++;
+	}
+	content_insert_byte(e->contents, offset, x);
+	editor_matches_edit(e, offset, 1);
+	editor_stats_invalidate(e);
+	ascii_cache_invalidate();
+	// Every byte after the inserted one shifts: every row changes, and the
+	// recorded dirty ranges no longer point at the right file offsets.
+	e->full_redraw = true;
+	e->dirty_ranges.track = false;
+
+	e->dirty = true;
+
+}
+
+
+void editor_replace_byte_at_offset(struct editor* e, size_t offset, char x) {
+	content_replace_byte(e->contents, offset, x);
+	editor_matches_edit(e, offset, 0);
+	editor_stats_edit(e, offset, 1);
+	ascii_cache_invalidate();
+	e->dirty = true;
+
+	editor_dirty_mark(e, offset, 1);
+
+	// Only the row containing the replaced byte needs to be redrawn.
+	// Mark it, so the next refresh re-emits it even when the cursor
+	// moved off it (e.g. on undo).
+	int x_unused, y;
+	editor_cursor_at_offset(e, offset, &x_unused, &y);
+	e->dirty_row = y;
+}
+
+void editor_replace_byte(struct editor* e, char x) {
+	size_t offset = editor_offset_at_cursor(e);
+	unsigned char prev = content_byte_at(e->contents, offset);
+	editor_replace_byte_at_offset(e, offset, x);
+	editor_move_cursor(e, KEY_RIGHT, 1);
+	editor_statusmessage(e, STATUS_INFO, "Replaced byte at offset %09llx with %02x",
+			(unsigned long long) offset, (unsigned char) x);
+	e->dirty = true;
+
+	action_list_add(e->undo_list, ACTION_REPLACE, offset, prev);
+}
+
+// Checksums stream through the piece table in chunks of this size, so a
+// digest over a multi-GB mapped file never allocates memory for it.
+#define CHECKSUM_CHUNK (64 * 1024)
+
+/*
+ * Handles the :crc32, :sha256 and :md5 commands. The optional arguments
+ * are a hexadecimal start and (exclusive) end offset; without them the
+ * whole buffer is hashed. The digest is put on the status line, where it
+ * can be compared against the crc32/sha256sum/md5sum tools.
+ */
+static void editor_checksum(struct editor* e, const char* cmd) {
+	char name[8] = {0};
+	char arg1[INPUT_BUF_SIZE] = {0};
+	char arg2[INPUT_BUF_SIZE] = {0};
+	int items_read = sscanf(cmd, "%7s %79s %79s", name, arg1, arg2);
+
+	size_t start = 0;
+	size_t end = e->contents->length;
+	if (items_read == 3) {
+		char* endp1;
+		char* endp2;
+		start = strtoull(arg1, &endp1, 16);
+		end = strtoull(arg2, &endp2, 16);
+		if (*endp1 != '\0' || *endp2 != '\0' || endp1 == arg1 || endp2 == arg2) {
+			editor_statusmessage(e, STATUS_ERROR, "Error: offsets are not valid base 16");
+			return;
+		}
+		if (start > end || end > e->contents->length) {
+			editor_statusmessage(e, STATUS_ERROR, "Error: invalid range (length is 0x%llx)",
+					(unsigned long long) e->contents->length);
+			return;
+		}
+	} else if (items_read == 2) {
+		editor_statusmessage(e, STATUS_ERROR, "%s command format: `%s [start end]` (hex offsets)", name, name);
+		return;
+	}
+
+	uint32_t crc = 0;
+	struct sha256_ctx sha;
+	struct md5_ctx md5;
+	int which = strcmp(name, "crc32") == 0 ? 0 : strcmp(name, "sha256") == 0 ? 1 : 2;
+	if (which == 1) {
+		sha256_init(&sha);
+	} else if (which == 2) {
+		md5_init(&md5);
+	}
+
+	char chunk[CHECKSUM_CHUNK];
+	for (size_t offset = start; offset < end;) {
+		size_t len = end - offset;
+		if (len > sizeof(chunk)) {
+			len = sizeof(chunk);
+		}
+		content_read(e->contents, offset, chunk, len);
+		switch (which) {
+		case 0: crc = crc32_update(crc, chunk, len); break;
+		case 1: sha256_update(&sha, chunk, len); break;
+		case 2: md5_update(&md5, chunk, len); break;
+		}
+		offset += len;
+	}
+
+	// Format the digest as lowercase hex. 32 bytes at most, so the
+	// longest result (sha256 plus the range prefix) fits the status line.
+	unsigned char digest[32];
+	int digest_len = 0;
+	char hex[sizeof(digest) * 2 + 1] = {0};
+	if (which == 0) {
+		snprintf(hex, sizeof(hex), "%08x", crc);
+	} else {
+		if (which == 1) {
+			sha256_final(&sha, digest);
+			digest_len = 32;
+		} else {
+			md5_final(&md5, digest);
+			digest_len = 16;
+		}
+		for (int i = 0; i < digest_len; i++) {
+			snprintf(hex + i * 2, 3, "%02x", digest[i]);
+		}
+	}
+
+	// Digest first: the status line clips at the screen width, and a
+	// clipped range echo is harmless while a clipped digest is useless.
+	editor_statusmessage(e, STATUS_INFO, "%s  %s(0x%llx-0x%llx)",
+			hex, name, (unsigned long long) start, (unsigned long long) end);
+}
+
+// Amount of octets per hex dump line (the xxd default).
+#define DUMP_OCTETS 16
+
+// Dump text is assembled and written to disk in chunks of this size, so
+// the export is bounded by the disk, not by a write call per line.
+#define DUMP_CHUNK (1024 * 1024)
+
+/*
+ * Handles the :export [start end] file command: writes the given range
+ * (hex offsets, the whole buffer when omitted) as an xxd-compatible hex
+ * dump. The lines are assembled from the precomputed per-byte render
+ * tables - two hex chars and the ASCII column char per byte value - so
+ * converting costs table loads and memcpys instead of a snprintf per
+ * byte, and the text goes out in megabyte-sized writes.
+ */
+static void editor_export(struct editor* e, const char* cmd) {
+	char arg1[INPUT_BUF_SIZE] = {0};
+	char arg2[INPUT_BUF_SIZE] = {0};
+	char arg3[INPUT_BUF_SIZE] = {0};
+	int items_read = sscanf(cmd, "%*s %79s %79s %79s", arg1, arg2, arg3);
+
+	size_t start = 0;
+	size_t end = e->contents->length;
+	const char* filename = arg1;
+	if (items_read == 3) {
+		char* endp1;
+		char* endp2;
+		start = strtoull(arg1, &endp1, 16);
+		end = strtoull(arg2, &endp2, 16);
+		if (*endp1 != '\0' || *endp2 != '\0' || endp1 == arg1 || endp2 == arg2) {
+			editor_statusmessage(e, STATUS_ERROR, "Error: offsets are not valid base 16");
+			return;
+		}
+		if (start > end || end > e->contents->length) {
+			editor_statusmessage(e, STATUS_ERROR, "Error: invalid range (length is 0x%llx)",
+					(unsigned long long) e->contents->length);
+			return;
+		}
+		filename = arg3;
+	} else if (items_read != 1) {
+		editor_statusmessage(e, STATUS_ERROR, "export command format: `export [start end] file` (hex offsets)");
+		return;
+	}
+
+	if (!render_tables_ready) {
+		render_tables_init();
+	}
+
+	FILE* fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		editor_statusmessage(e, STATUS_ERROR, "Unable to open '%s' for writing: %s", filename, strerror(errno));
+		return;
+	}
+
+	char* out = malloc(DUMP_CHUNK);
+	if (out == NULL) {
+		perror("Unable to allocate dump buffer");
+		exit(1);
+	}
+	size_t outlen = 0;
+
+	// A full line: 8 offset digits, ": ", 8 groups of 4 hex chars plus a
+	// space, one more space, the ASCII column and a newline.
+	const size_t linelen = 8 + 2 + (DUMP_OCTETS / 2) * 5 + 1 + DUMP_OCTETS + 1;
+
+	char row[DUMP_OCTETS];
+	for (size_t offset = start; offset < end; offset += DUMP_OCTETS) {
+		size_t len = end - offset;
+		if (len > DUMP_OCTETS) {
+			len = DUMP_OCTETS;
+		}
+		content_read(e->contents, offset, row, len);
+
+		if (outlen + linelen > DUMP_CHUNK) {
+			if (fwrite(out, 1, outlen, fp) != outlen) {
+				editor_statusmessage(e, STATUS_ERROR, "Unable write to file: %s", strerror(errno));
+				free(out);
+				fclose(fp);
+				return;
+			}
+			outlen = 0;
+		}
+
+		char* p = out + outlen;
+		static const char digits[] = "0123456789abcdef";
+		for (int i = 7; i >= 0; i--) {
+			*p++ = digits[(offset >> (i * 4)) & 0xf];
+		}
+		*p++ = ':';
+		*p++ = ' ';
+		for (size_t i = 0; i < DUMP_OCTETS; i++) {
+			if (i < len) {
+				unsigned char b = row[i];
+				*p++ = hex_table[b][0];
+				*p++ = hex_table[b][1];
+			} else {
+				// Pad a partial last line, keeping the ASCII column
+				// aligned.
+				*p++ = ' ';
+				*p++ = ' ';
+			}
+			if (i % 2 == 1) {
+				*p++ = ' ';
+			}
+		}
+		*p++ = ' ';
+		for (size_t i = 0; i < len; i++) {
+			*p++ = asc_table[(unsigned char) row[i]];
+		}
+		*p++ = '\n';
+		outlen = p - out;
+	}
+
+	if (outlen > 0 && fwrite(out, 1, outlen, fp) != outlen) {
+		editor_statusmessage(e, STATUS_ERROR, "Unable write to file: %s", strerror(errno));
+		free(out);
+		fclose(fp);
+		return;
+	}
+	free(out);
+	fclose(fp);
+
+	editor_statusmessage(e, STATUS_INFO, "Exported 0x%llx-0x%llx to '%s'",
+			(unsigned long long) start, (unsigned long long) end, filename);
+}
+
+/*
+ * Handles the :import file command: replaces the buffer with the binary
+ * a hex dump describes, like xxd -r. Each line is an offset, a colon and
+ * hex pairs up to the double space before the ASCII column; bytes land
+ * at their line's offset, and gaps between lines come out zero-filled.
+ * The decode is driven by a 256-entry nibble table instead of a
+ * per-character branch ladder, so parsing keeps up with the disk.
+ */
+static void editor_import(struct editor* e, const char* cmd) {
+	char filename[INPUT_BUF_SIZE] = {0};
+	if (sscanf(cmd, "%*s %79s", filename) != 1) {
+		editor_statusmessage(e, STATUS_ERROR, "import command format: `import file`");
+		return;
+	}
+
+	FILE* fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		editor_statusmessage(e, STATUS_ERROR, "Unable to open '%s': %s", filename, strerror(errno));
+		return;
+	}
+	size_t text_len = 0;
+	char* text = editor_read_stream(fp, &text_len);
+	fclose(fp);
+
+	// Value of every character as a hex digit, or -1. Table lookups make
+	// the pair decode two loads and a test per byte.
+	static signed char unhex[256];
+	static bool unhex_ready = false;
+	if (!unhex_ready) {
+		memset(unhex, -1, sizeof(unhex));
+		for (int i = 0; i < 16; i++) {
+			unhex[(unsigned char) "0123456789abcdef"[i]] = i;
+			unhex[(unsigned char) "0123456789ABCDEF"[i]] = i;
+		}
+		unhex_ready = true;
+	}
+
+	char* bin = NULL;
+	size_t bin_len = 0; // highest offset written plus one.
+	size_t bin_cap = 0;
+
+	size_t pos = 0;
+	size_t line = 0;
+	while (pos < text_len) {
+		line++;
+
+		// The offset, up to the colon.
+		size_t offset = 0;
+		size_t p = pos;
+		while (p < text_len && unhex[(unsigned char) text[p]] >= 0) {
+			offset = offset * 16 + unhex[(unsigned char) text[p]];
+			p++;
+		}
+		if (p == pos || p >= text_len || text[p] != ':') {
+			editor_statusmessage(e, STATUS_ERROR, "Error: '%s' line %zu is not a hex dump line", filename, line);
+			free(text);
+			free(bin);
+			return;
+		}
+		p++;
+
+		// The hex pairs, with single spaces between groups. Two spaces in
+		// a row start the ASCII column, which is ignored.
+		size_t n = 0;
+		for (;;) {
+			if (p < text_len && text[p] == ' ') {
+				p++;
+				if (p < text_len && text[p] == ' ') {
+					break;
+				}
+			}
+			if (p + 1 >= text_len) {
+				break;
+			}
+			int hi = unhex[(unsigned char) text[p]];
+			int lo = unhex[(unsigned char) text[p + 1]];
+			if (hi < 0 || lo < 0) {
+				break;
+			}
+			if (offset + n >= bin_cap) {
+				size_t cap = bin_cap == 0 ? STREAM_BLOCK : bin_cap;
+				while (offset + n >= cap) {
+					cap *= 2;
+				}
+				bin = realloc(bin, cap);
+				if (bin == NULL) {
+					perror("Unable to realloc import buffer");
+					exit(1);
+				}
+				// Lines may leave holes (a partial dump); those bytes
+				// read back as zeroes.
+				memset(bin + bin_cap, 0, cap - bin_cap);
+				bin_cap = cap;
+			}
+			bin[offset + n] = (hi << 4) | lo;
+			n++;
+			p += 2;
+		}
+		if (offset + n > bin_len) {
+			bin_len = offset + n;
+		}
+
+		// Skip the rest of the line (the ASCII column).
+		while (p < text_len && text[p] != '\n') {
+			p++;
+		}
+		pos = p + 1;
+	}
+	free(text);
+
+	if (bin_len == 0) {
+		editor_statusmessage(e, STATUS_ERROR, "Error: no hex dump lines in '%s'", filename);
+		free(bin);
+		return;
+	}
+
+	// Swap the decoded binary in as the new contents. The undo history
+	// and the checkpoints describe the old buffers and cannot survive.
+	content_free(e->contents);
+	e->contents = content_from_buffer(bin, bin_len);
+	// The orig buffer is the imported dump, not the on-disk file; an
+	// in-place patch against it would silently leave the file's old
+	// bytes behind. Saves must take the full-rewrite path.
+	e->contents->orig_mirrors_file = false;
+	action_list_free(e->undo_list);
+	e->undo_list = action_list_init();
+	struct checkpoint* cp = e->checkpoints;
+	while (cp != NULL) {
+		struct checkpoint* next = cp->next;
+		content_snapshot_free(cp->snap);
+		free(cp);
+		cp = next;
+	}
+	e->checkpoints = NULL;
+	editor_matches_clear(e);
+	editor_stats_drop(e);
+	ascii_cache_invalidate();
+	e->dirty_ranges.track = false;
+	e->dirty = true;
+	e->full_redraw = true;
+	editor_scroll_to_offset(e, 0);
+
+	editor_statusmessage(e, STATUS_INFO, "Imported %zu byte(s) from '%s'", bin_len, filename);
+}
+
+/*
+ * Counts the byte values of `len' bytes into `hist'. Four interleaved
+ * sub-tables break the store-to-load dependency a single table has on
+ * runs of equal byte values - the limit of a plain counting loop - so
+ * the scan runs at memory bandwidth.
+ */
+static void stats_count(const unsigned char* buf, size_t len, uint16_t hist[256]) {
+	uint32_t sub[4][256];
+	memset(sub, 0, sizeof(sub));
+
+	size_t i = 0;
+	for (; i + 4 <= len; i += 4) {
+		sub[0][buf[i]]++;
+		sub[1][buf[i + 1]]++;
+		sub[2][buf[i + 2]]++;
+		sub[3][buf[i + 3]]++;
+	}
+	for (; i < len; i++) {
+		sub[0][buf[i]]++;
+	}
+
+	for (int b = 0; b < 256; b++) {
+		hist[b] = sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+	}
+}
+
+/*
+ * Returns the Shannon entropy over a block's byte counts, scaled from
+ * 0..8 bits per byte to 0..255.
+ */
+static unsigned char stats_entropy(const uint16_t hist[256], size_t len) {
+	double h = 0.0;
+	for (int i = 0; i < 256; i++) {
+		if (hist[i] > 0) {
+			double p = (double) hist[i] / len;
+			h -= p * log2(p);
+		}
+	}
+	return (unsigned char) (h * (255.0 / 8.0) + 0.5);
+}
+
+/*
+ * Frees the statistics arrays and marks them invalid. The sparkline
+ * column disappears until :stats computes them again.
+ */
+static void editor_stats_drop(struct editor* e) {
+	free(e->stats.hist);
+	free(e->stats.entropy);
+	e->stats.hist = NULL;
+	e->stats.entropy = NULL;
+	e->stats.block_count = 0;
+	e->stats.valid = false;
+}
+
+/*
+ * Recounts the blocks covering [offset, offset + len) after an in-place
+ * edit. Only the touched blocks are re-read and re-counted, so the cost
+ * of keeping the statistics current is proportional to the edit, not to
+ * the file.
+ */
+static void editor_stats_edit(struct editor* e, size_t offset, size_t len) {
+	if (!e->stats.valid || len == 0) {
+		return;
+	}
+
+	size_t first = offset / STATS_BLOCK;
+	size_t last = (offset + len - 1) / STATS_BLOCK;
+	char block[STATS_BLOCK];
+	for (size_t bi = first; bi <= last && bi < e->stats.block_count; bi++) {
+		size_t bstart = bi * STATS_BLOCK;
+		size_t blen = e->contents->length - bstart;
+		if (blen > STATS_BLOCK) {
+			blen = STATS_BLOCK;
+		}
+		content_read(e->contents, bstart, block, blen);
+		stats_count((unsigned char*) block, blen, e->stats.hist[bi]);
+		e->stats.entropy[bi] = stats_entropy(e->stats.hist[bi], blen);
+	}
+}
+
+/*
+ * Invalidates the statistics after an edit that shifted offsets: every
+ * block after the edit now covers different bytes, so the counts no
+ * longer describe the contents.
+ */
+static void editor_stats_invalidate(struct editor* e) {
+	if (e->stats.valid) {
+		e->stats.valid = false;
+		// The sparkline column disappears, so redraw every row.
+		e->full_redraw = true;
+	}
+}
+
+/*
+ * State shared between the main thread and the stats worker, following
+ * the search job: the worker only writes the counts, `progress' and
+ * `done'; the main thread only writes `cancel'.
+ */
+struct stats_job {
+	struct content* contents;
+	uint16_t (*hist)[256];  // byte counts per block, filled in order.
+	unsigned char* entropy; // entropy per block.
+	size_t block_count;
+
+	volatile bool   cancel;   // main thread: request the worker to stop.
+	volatile bool   done;     // worker: scan finished (or cancelled).
+	volatile size_t progress; // worker: bytes counted so far.
+};
+
+static void* editor_stats_worker(void* arg) {
+	struct stats_job* job = arg;
+
+	char block[STATS_BLOCK];
+	for (size_t bi = 0; bi < job->block_count && !job->cancel; bi++) {
+		size_t bstart = bi * STATS_BLOCK;
+		size_t blen = job->contents->length - bstart;
+		if (blen > STATS_BLOCK) {
+			blen = STATS_BLOCK;
+		}
+		content_read(job->contents, bstart, block, blen);
+		stats_count((unsigned char*) block, blen, job->hist[bi]);
+		job->entropy[bi] = stats_entropy(job->hist[bi], blen);
+		job->progress = bstart + blen;
+	}
+
+	job->done = true;
+	return NULL;
+}
+
+/*
+ * Handles the :stats command: computes the byte histogram and per-block
+ * entropy and turns the sparkline column on, or turns it off when it is
+ * already showing. The summary line makes the ent/binwalk round trip
+ * for "is this region compressed or encrypted" unnecessary: the overall
+ * entropy, the most common byte and how many blocks look random. Large
+ * files are scanned on a worker thread with progress on the status line
+ * and ESC to cancel.
+ */
+static void editor_stats(struct editor* e) {
+	if (e->stats.enabled && e->stats.valid) {
+		e->stats.enabled = false;
+		editor_stats_drop(e);
+		e->full_redraw = true;
+		editor_statusmessage(e, STATUS_INFO, "Stats disabled");
+		return;
+	}
+
+	if (e->contents->length == 0) {
+		editor_statusmessage(e, STATUS_WARNING, "File is empty");
+		return;
+	}
+
+	editor_stats_drop(e);
+	size_t block_count = (e->contents->length + STATS_BLOCK - 1) / STATS_BLOCK;
+	uint16_t (*hist)[256] = malloc(block_count * sizeof(*hist));
+	unsigned char* entropy = malloc(block_count);
+	if (hist == NULL || entropy == NULL) {
+		perror("Unable to allocate stats");
+		exit(1);
+	}
+
+	struct stats_job job;
+	memset(&job, 0, sizeof(job));
+	job.contents = e->contents;
+	job.hist = hist;
+	job.entropy = entropy;
+	job.block_count = block_count;
+
+	pthread_t thread;
+	bool threaded = e->contents->length >= STATS_THREAD_THRESHOLD
+		&& pthread_create(&thread, NULL, editor_stats_worker, &job) == 0;
+
+	if (threaded) {
+		while (!job.done) {
+			if (key_available(100)) {
+				if (read_key() == KEY_ESC) {
+					job.cancel = true;
+				}
+			}
+			int pct = (int) (job.progress * 100 / e->contents->length);
+			editor_statusmessage(e, STATUS_INFO, "Scanning... %d%% (ESC to cancel)", pct);
+			editor_draw_statusline(e);
+		}
+		pthread_join(thread, NULL);
+	} else {
+		editor_stats_worker(&job);
+	}
+
+	if (job.cancel) {
+		free(hist);
+		free(entropy);
+		editor_statusmessage(e, STATUS_WARNING, "Stats scan cancelled");
+		return;
+	}
+
+	e->stats.hist = hist;
+	e->stats.entropy = entropy;
+	e->stats.block_count = block_count;
+	e->stats.valid = true;
+	e->stats.enabled = true;
+	e->full_redraw = true;
+
+	// The summary needs the whole-file histogram: the per-block counts
+	// summed into 64-bit bins.
+	uint64_t total[256];
+	memset(total, 0, sizeof(total));
+	for (size_t bi = 0; bi < block_count; bi++) {
+		for (int b = 0; b < 256; b++) {
+			total[b] += hist[bi][b];
+		}
+	}
+	double h = 0.0;
+	int peak = 0;
+	for (int b = 0; b < 256; b++) {
+		if (total[b] > 0) {
+			double p = (double) total[b] / e->contents->length;
+			h -= p * log2(p);
+		}
+		if (total[b] > total[peak]) {
+			peak = b;
+		}
+	}
+	// Blocks at or above 7.5 bits per byte look random: compressed,
+	// encrypted or plain noise.
+	size_t random_blocks = 0;
+	for (size_t bi = 0; bi < block_count; bi++) {
+		if (entropy[bi] >= (unsigned char) (7.5 * 255.0 / 8.0)) {
+			random_blocks++;
+		}
+	}
+
+	editor_statusmessage(e, STATUS_INFO,
+		"Entropy %.3f bits/byte; peak byte 0x%02x (x%llu); %zu/%zu block(s) look random",
+		h, peak, (unsigned long long) total[peak], random_blocks, block_count);
+}
+
+/*
+ * One extracted string: where it starts and how long it runs. The bytes
+ * themselves are re-read from the contents when a picker row is drawn,
+ * so the result list stays small however large the file is.
+ */
+struct string_hit {
+	size_t offset; // first byte of the printable run.
+	size_t len;    // length of the run.
+};
+
+/*
+ * State shared between the main thread and the strings worker, following
+ * the search job: the worker only writes the results, `progress' and
+ * `done'; the main thread only writes `cancel'.
+ */
+struct strings_job {
+	struct content* contents;
+	size_t minlen; // minimum run length worth recording.
+
+	struct string_hit* hits; // printable runs found, in offset order.
+	size_t count;
+	size_t cap;
+
+	volatile bool   cancel;   // main thread: request the worker to stop.
+	volatile bool   done;     // worker: scan finished (or cancelled).
+	volatile size_t progress; // worker: bytes scanned so far.
+};
+
+/*
+ * Appends a printable run to the job's result list.
+ */
+static void strings_job_push(struct strings_job* job, size_t offset, size_t len) {
+	if (job->count >= job->cap) {
+		job->cap = job->cap == 0 ? 256 : job->cap * 2;
+		job->hits = realloc(job->hits, job->cap * sizeof(struct string_hit));
+		if (job->hits == NULL) {
+			perror("Unable to realloc string hits");
+			exit(1);
+		}
+	}
+	job->hits[job->count].offset = offset;
+	job->hits[job->count].len = len;
+	job->count++;
+}
+
+/*
+ * Scans the whole contents chunkwise for printable runs of at least
+ * `minlen' bytes - the same decision the render path makes per byte, but
+ * classified 16 bytes per compare: hx_findprint skips the unprintable
+ * stretches and hx_printable_prefix extends a run. Runs crossing a chunk
+ * boundary are carried into the next chunk.
+ */
+static void* editor_strings_worker(void* arg) {
+	struct strings_job* job = arg;
+	struct content* c = job->contents;
+
+	char chunk[65536];
+	size_t run_start = 0; // start offset of the current printable run.
+	size_t run_len = 0;   // its length so far; 0 when not inside a run.
+
+	size_t offset = 0;
+	while (!job->cancel && offset < c->length) {
+		size_t got = content_read(c, offset, chunk, sizeof(chunk));
+		size_t pos = 0;
+		while (pos < got) {
+			if (run_len == 0) {
+				char* p = hx_findprint(chunk + pos, got - pos);
+				if (p == NULL) {
+					break;
+				}
+				pos = p - chunk;
+				run_start = offset + pos;
+			}
+			size_t ext = hx_printable_prefix(chunk + pos, got - pos);
+			run_len += ext;
+			pos += ext;
+			if (pos < got) {
+				// The run ended inside this chunk.
+				if (run_len >= job->minlen) {
+					strings_job_push(job, run_start, run_len);
+				}
+				run_len = 0;
+			}
+		}
+		offset += got;
+		job->progress = offset;
+	}
+
+	// A run still open at the end of the file.
+	if (!job->cancel && run_len >= job->minlen) {
+		strings_job_push(job, run_start, run_len);
+	}
+
+	job->done = true;
+	return NULL;
+}
+
+/*
+ * Presents the extracted strings in a scrollable picker, rendered
+ * outside any mode like the help screen. j/k and the arrows move the
+ * selection, CTRL+D/CTRL+U page, ENTER jumps to the selected string via
+ * editor_scroll_to_offset and ESC or q leaves the list.
+ */
+static void editor_strings_picker(struct editor* e, struct string_hit* hits, size_t count) {
+	struct charbuf* b = charbuf_create();
+	size_t sel = 0;
+	size_t top = 0;
+
+	// Amount of list rows: everything but the header line.
+	size_t rows = e->screen_rows > 1 ? (size_t) e->screen_rows - 1 : 1;
+
+	// A row shows the offset, a separator and the string, clipped to the
+	// screen width.
+	char text[256];
+	size_t text_max = sizeof(text) - 1;
+	if (e->screen_cols > 11 && (size_t) e->screen_cols - 11 < text_max) {
+		text_max = e->screen_cols - 11;
+	}
+
+	for (;;) {
+		if (sel < top) {
+			top = sel;
+		}
+		if (sel >= top + rows) {
+			top = sel - rows + 1;
+		}
+
+		charbuf_reset(b);
+		charbuf_append(b, "\x1b[?25l\x1b[H", 9);
+		charbuf_appendf(b, "\x1b[0m%llu string(s); ENTER jumps to the selection, ESC leaves\x1b[K\r\n",
+				(unsigned long long) count);
+		for (size_t i = top; i < top + rows && i < count; i++) {
+			size_t len = hits[i].len < text_max ? hits[i].len : text_max;
+			content_read(e->contents, hits[i].offset, text, len);
+			charbuf_appendf(b, i == sel ? "\x1b[7m\x1b[1;35m%09llx\x1b[39m: " : "\x1b[1;35m%09llx\x1b[0m: ",
+					(unsigned long long) hits[i].offset);
+			charbuf_append(b, text, len);
+			charbuf_append(b, "\x1b[0m\x1b[K\r\n", 9);
+		}
+		charbuf_append(b, "\x1b[0m\x1b[J", 7);
+		charbuf_draw(b);
+
+		int c = read_key();
+		switch (c) {
+		case KEY_UP:
+		case 'k': if (sel > 0) sel--; break;
+		case KEY_DOWN:
+		case 'j': if (sel + 1 < count) sel++; break;
+		case KEY_CTRL_U:
+		case KEY_PAGEUP:   sel = sel > rows ? sel - rows : 0; break;
+		case KEY_CTRL_D:
+		case KEY_PAGEDOWN: sel = sel + rows < count ? sel + rows : count - 1; break;
+		case KEY_HOME: sel = 0; break;
+		case KEY_END:  sel = count - 1; break;
+		case KEY_ENTER:
+			editor_scroll_to_offset(e, hits[sel].offset);
+			editor_statusmessage(e, STATUS_INFO, "Jumped to string at offset %09llx",
+					(unsigned long long) hits[sel].offset);
+			// Jumping also leaves the picker.
+			// fall through
+		case KEY_ESC:
+		case 'q':
+			charbuf_free(b);
+			clear_screen();
+			// The picker wiped the contents, so redraw everything.
+			e->full_redraw = true;
+			return;
+		}
+	}
+}
+
+/*
+ * Handles the :strings [minlen] command: extracts every printable run of
+ * at least `minlen' (default 4) bytes and opens the picker on the
+ * result, so a strings(1)-and-grep round trip outside the editor is not
+ * needed to hunt the offsets back. Large files are scanned on a worker
+ * thread with progress on the status line and ESC to cancel.
+ */
+static void editor_strings(struct editor* e, const char* cmd) {
+	int minlen = STRINGS_MIN_DEFAULT;
+	sscanf(cmd, "strings %d", &minlen);
+	minlen = clampi(minlen, 1, 4096);
+
+	struct strings_job job;
+	memset(&job, 0, sizeof(job));
+	job.contents = e->contents;
+	job.minlen = minlen;
+
+	pthread_t thread;
+	bool threaded = e->contents->length >= STRINGS_THREAD_THRESHOLD
+		&& pthread_create(&thread, NULL, editor_strings_worker, &job) == 0;
+
+	if (threaded) {
+		while (!job.done) {
+			if (key_available(100)) {
+				if (read_key() == KEY_ESC) {
+					job.cancel = true;
+				}
+			}
+			int pct = e->contents->length > 0
+				? (int) (job.progress * 100 / e->contents->length) : 100;
+			editor_statusmessage(e, STATUS_INFO, "Extracting strings... %d%% (ESC to cancel)", pct);
+			editor_draw_statusline(e);
+		}
+		pthread_join(thread, NULL);
+	} else {
+		editor_strings_worker(&job);
+	}
+
+	if (job.cancel) {
+		editor_statusmessage(e, STATUS_WARNING, "Strings extraction cancelled");
+		free(job.hits);
+		return;
+	}
+	if (job.count == 0) {
+		editor_statusmessage(e, STATUS_WARNING, "No strings of at least %d bytes found", minlen);
+		free(job.hits);
+		return;
+	}
+
+	editor_strings_picker(e, job.hits, job.count);
+	free(job.hits);
+}
+
+/*
+ * Handles the :s/pattern/replacement/ command: replaces every occurrence
+ * of the pattern in one pass. Both sides take the search escapes (\xXY
+ * and \\); a literal '/' can be written as \x2f. The replacements are
+ * applied as a single splice covering the span from the first match to
+ * the end of the last, and recorded as one undoable action, instead of a
+ * scan, splice and redraw per occurrence.
+ */
+static void editor_replace_all(struct editor* e, const char* cmd) {
+	// Split "s/pattern/replacement[/]" on the raw slashes; the escapes
+	// are parsed afterwards, per side.
+	const char* pat = cmd + 2;
+	const char* sep = strchr(pat, '/');
+	if (sep == NULL || sep == pat) {
+		editor_statusmessage(e, STATUS_ERROR, "s command format: `s/pattern/replacement/'");
+		return;
+	}
+	const char* rep = sep + 1;
+	size_t patlen = sep - pat;
+	size_t replen = strlen(rep);
+	if (replen > 0 && rep[replen - 1] == '/') {
+		replen--;
+	}
+	if (patlen >= INPUT_BUF_SIZE || replen >= INPUT_BUF_SIZE) {
+		editor_statusmessage(e, STATUS_ERROR, "Error: pattern or replacement too long");
+		return;
+	}
+	char patstr[INPUT_BUF_SIZE] = {0};
+	char repstr[INPUT_BUF_SIZE] = {0};
+	memcpy(patstr, pat, patlen);
+	memcpy(repstr, rep, replen);
+
+	struct charbuf* pparsed = charbuf_create();
+	struct charbuf* rparsed = charbuf_create();
+	const char* parse_err;
+	if (editor_parse_search_string(patstr, pparsed, &parse_err) != PARSE_SUCCESS) {
+		editor_statusmessage(e, STATUS_ERROR, "Invalid pattern: %s", patstr);
+		charbuf_free(pparsed);
+		charbuf_free(rparsed);
+		return;
+	}
+	if (editor_parse_search_string(repstr, rparsed, &parse_err) != PARSE_SUCCESS) {
+		editor_statusmessage(e, STATUS_ERROR, "Invalid replacement: %s", repstr);
+		charbuf_free(pparsed);
+		charbuf_free(rparsed);
+		return;
+	}
+	size_t plen = pparsed->len;
+	size_t rlen = rparsed->len;
+	if (plen == 0) {
+		editor_statusmessage(e, STATUS_ERROR, "Error: empty pattern");
+		charbuf_free(pparsed);
+		charbuf_free(rparsed);
+		return;
+	}
+
+	// One pass: collect every (non-overlapping) match up front.
+	size_t* offsets = NULL;
+	size_t count = 0;
+	size_t cap = 0;
+	size_t from = 0;
+	for (;;) {
+		long long m = content_search_forward(e->contents, pparsed->contents, plen, from);
+		if (m < 0) {
+			break;
+		}
+		if (count >= cap) {
+			cap = cap == 0 ? 64 : cap * 2;
+			offsets = realloc(offsets, cap * sizeof(size_t));
+			if (offsets == NULL) {
+				perror("Unable to realloc replace offsets");
+				exit(1);
+			}
+		}
+		offsets[count++] = m;
+		from = m + plen;
+	}
+
+	if (count == 0) {
+		editor_statusmessage(e, STATUS_WARNING, "String not found: '%s'", patstr);
+		charbuf_free(pparsed);
+		charbuf_free(rparsed);
+		return;
+	}
+
+	// The affected window runs from the first match to the end of the
+	// last. Everything outside it keeps its bytes; when the lengths
+	// differ, the piece table shifts the tail as part of the one splice.
+	size_t first = offsets[0];
+	size_t wend = offsets[count - 1] + plen;
+	size_t wlen = wend - first;
+	size_t new_wlen = wlen - count * plen + count * rlen;
+
+	unsigned char* old_span = malloc(wlen);
+	unsigned char* new_span = malloc(new_wlen > 0 ? new_wlen : 1);
+	if (old_span == NULL || new_span == NULL) {
+		perror("Unable to allocate replace spans");
+		exit(1);
+	}
+	content_read(e->contents, first, (char*) old_span, wlen);
+
+	// Build the replaced window: the stretches between matches copied
+	// verbatim, the replacement in place of each match.
+	size_t src = first;
+	size_t dst = 0;
+	for (size_t i = 0; i < count; i++) {
+		size_t keep = offsets[i] - src;
+		memcpy(new_span + dst, old_span + (src - first), keep);
+		dst += keep;
+		memcpy(new_span + dst, rparsed->contents, rlen);
+		dst += rlen;
+		src = offsets[i] + plen;
+	}
+	free(offsets);
+
+	// Splice the new window in as a whole.
+	content_delete(e->contents, first, wlen);
+	content_insert(e->contents, first, (const char*) new_span, new_wlen);
+	free(new_span);
+
+	if (rlen == plen) {
+		// Equal lengths: nothing shifts, so a plain replace span both
+		// undoes it and keeps the incremental save path usable.
+		action_list_add_span(e->undo_list, ACTION_REPLACE, first, old_span, wlen);
+		editor_dirty_mark(e, first, wlen);
+		editor_stats_edit(e, first, wlen);
+	} else {
+		action_list_add_rewrite(e->undo_list, first, old_span, wlen, new_wlen);
+		e->dirty_ranges.track = false;
+		editor_stats_invalidate(e);
+	}
+
+	editor_matches_clear(e);
+	ascii_cache_invalidate();
+	e->dirty = true;
+	e->full_redraw = true;
+
+	editor_scroll_to_offset(e, first);
+	editor_statusmessage(e, STATUS_INFO, "Replaced %llu occurrence(s) of '%s'",
+			(unsigned long long) count, patstr);
+	charbuf_free(pparsed);
+	charbuf_free(rparsed);
 }
 
+/*
+ * Looks up a checkpoint by name, or NULL when there is none.
+ */
+static struct checkpoint* editor_checkpoint_find(struct editor* e, const char* name) {
+	for (struct checkpoint* cp = e->checkpoints; cp != NULL; cp = cp->next) {
+		if (strncmp(cp->name, name, INPUT_BUF_SIZE) == 0) {
+			return cp;
+		}
+	}
+	return NULL;
+}
 
-void editor_insert_byte(struct editor* e, char x, bool after) {
-	int offset = editor_offset_at_cursor(e);
-	editor_insert_byte_at_offset(e, offset, x, after);
+/*
+ * Handles the :checkpoint [name] command: takes a named snapshot of the
+ * contents. The name defaults to "default"; retaking an existing name
+ * replaces its snapshot. Snapshots copy the piece chain only, never file
+ * bytes, so this is instant regardless of the file size.
+ */
+static void editor_checkpoint(struct editor* e, const char* cmd) {
+	const char* name = cmd + 10;
+	while (name[0] == ' ') name++;
+	if (name[0] == '\0') {
+		name = "default";
+	}
 
-	if (after) {
-		action_list_add(e->undo_list, ACTION_APPEND, offset, x);
+	struct checkpoint* cp = editor_checkpoint_find(e, name);
+	if (cp != NULL) {
+		content_snapshot_free(cp->snap);
 	} else {
-		action_list_add(e->undo_list, ACTION_INSERT, offset, x);
+		cp = malloc(sizeof(struct checkpoint));
+		if (cp == NULL) {
+			perror("Unable to allocate checkpoint");
+			exit(1);
+		}
+		snprintf(cp->name, INPUT_BUF_SIZE, "%s", name);
+		cp->next = e->checkpoints;
+		e->checkpoints = cp;
 	}
+	cp->snap = content_snapshot_take(e->contents);
+	cp->save_count = e->save_count;
+
+	editor_statusmessage(e, STATUS_INFO, "Checkpoint '%s' taken at %zu byte(s)",
+			cp->name, e->contents->length);
 }
 
-void editor_insert_byte_at_offset(struct editor* e, unsigned int offset, char x, bool after) {
-	// We are inserting a single character. Reallocate memory to contain
-	// this extra byte.
-	e->contents = realloc(e->contents, e->content_length + 1);
+/*
+ * Handles the :revert [name] command: restores the contents to the state
+ * of a checkpoint. The checkpoint survives and can be reverted to again.
+ * The undo history is cleared, since its recorded offsets describe edits
+ * against a state that no longer exists.
+ */
+static void editor_revert(struct editor* e, const char* cmd) {
+	const char* name = cmd + 6;
+	while (name[0] == ' ') name++;
+	if (name[0] == '\0') {
+		name = "default";
+	}
 
-	if (after && e->content_length) { // append is the same as insert when buffer is empty
-		offset++;
+	struct checkpoint* cp = editor_checkpoint_find(e, name);
+	if (cp == NULL) {
+		editor_statusmessage(e, STATUS_ERROR, "No checkpoint named '%s'", name);
+		return;
 	}
-	//          v
-	// |t|e|s|t|b|y|t|e|s|...
-	// |t|e|s|t|_|b|y|t|e|s|...
-	memmove(e->contents + offset + 1, e->contents + offset, e->content_length - offset);
 
-	e->contents[offset] = x;
+	content_snapshot_restore(e->contents, cp->snap);
 
-	// Increase the content length since we inserted a character.
-	e->content_length++;
+	if (e->save_count != cp->save_count) {
+		// A save flushed the buffer since this snapshot was taken, so
+		// the on-disk file no longer matches the original data outside
+		// the restored chain's add pieces; an in-place patch would
+		// silently leave the flushed bytes behind. Full rewrites only
+		// from here on.
+		e->contents->orig_mirrors_file = false;
+	}
 
+	action_list_free(e->undo_list);
+	e->undo_list = action_list_init();
+	editor_matches_clear(e);
+	editor_stats_invalidate(e);
+	ascii_cache_invalidate();
+	// The restore may have shifted offsets arbitrarily relative to the
+	// last save, so the incremental save ranges are meaningless.
+	e->dirty_ranges.track = false;
 	e->dirty = true;
+	e->full_redraw = true;
 
-}
-
-
-void editor_replace_byte(struct editor* e, char x) {
-	unsigned int offset = editor_offset_at_cursor(e);
-	unsigned char prev = e->contents[offset];
-	e->contents[offset] = x;
-	editor_move_cursor(e, KEY_RIGHT, 1);
-	editor_statusmessage(e, STATUS_INFO, "Replaced byte at offset %09x with %02x", offset, (unsigned char) x);
-	e->dirty = true;
+	size_t offset = editor_offset_at_cursor(e);
+	if (e->contents->length > 0 && offset >= e->contents->length) {
+		offset = e->contents->length - 1;
+	}
+	editor_scroll_to_offset(e, offset);
 
-	action_list_add(e->undo_list, ACTION_REPLACE, offset, prev);
+	editor_statusmessage(e, STATUS_INFO, "Reverted to checkpoint '%s' (%zu byte(s))",
+			cp->name, e->contents->length);
 }
 
 void editor_process_command(struct editor* e, const char* cmd) {
 	// Command: go to base 10 offset
 	bool b = is_pos_num(cmd);
 	if (b) {
-		int offset = str2int(cmd, 0, e->content_length, e->content_length - 1);
+		off_t offset = str2off(cmd, 0, e->contents->length, e->contents->length - 1);
 		editor_scroll_to_offset(e, offset);
-		editor_statusmessage(e, STATUS_INFO, "Positioned to offset 0x%09x (%d)", offset, offset);
+		editor_statusmessage(e, STATUS_INFO, "Positioned to offset 0x%09llx (%lld)",
+				(unsigned long long) offset, (long long) offset);
 		return;
 	}
 
@@ -777,9 +2980,10 @@ void editor_process_command(struct editor* e, const char* cmd) {
 			return;
 		}
 
-		int offset = hex2int(ptr);
+		off_t offset = hex2off(ptr);
 		editor_scroll_to_offset(e, offset);
-		editor_statusmessage(e, STATUS_INFO, "Positioned to offset 0x%09x (%d)", offset, offset);
+		editor_statusmessage(e, STATUS_INFO, "Positioned to offset 0x%09llx (%lld)",
+				(unsigned long long) offset, (long long) offset);
 		return;
 	}
 
@@ -819,6 +3023,9 @@ void editor_process_command(struct editor* e, const char* cmd) {
 		while (thingy_def[0] == ' ') thingy_def++;
 
 		int r = thingy_table_add_from_string(e->thingies, thingy_def);
+		// The cached row decodes hold pointers into the table.
+		ascii_cache_invalidate();
+		e->full_redraw = true;
 		if (r > 16) {
 			editor_statusmessage(e, STATUS_ERROR, "unable to delete this key");
 		} else if (r == 16) {
@@ -831,6 +3038,62 @@ void editor_process_command(struct editor* e, const char* cmd) {
 		return;
 	}
 	
+	if (strncmp(cmd, "perf", INPUT_BUF_SIZE) == 0) {
+		if (!e->perf.enabled) {
+			// Start with empty rings, so old numbers from a previous
+			// toggle do not skew the percentiles.
+			memset(&e->perf, 0, sizeof(e->perf));
+			e->perf.enabled = true;
+			editor_statusmessage(e, STATUS_INFO, "Performance HUD enabled");
+		} else {
+			e->perf.enabled = false;
+			editor_statusmessage(e, STATUS_INFO, "Performance HUD disabled");
+		}
+		return;
+	}
+
+	if (strncmp(cmd, "strings", 7) == 0) {
+		editor_strings(e, cmd);
+		return;
+	}
+
+	if (cmd[0] == 's' && cmd[1] == '/') {
+		editor_replace_all(e, cmd);
+		return;
+	}
+
+	if (strncmp(cmd, "crc32", 5) == 0
+	 || strncmp(cmd, "sha256", 6) == 0
+	 || strncmp(cmd, "md5", 3) == 0) {
+		editor_checksum(e, cmd);
+		return;
+	}
+
+	if (strncmp(cmd, "export", 6) == 0) {
+		editor_export(e, cmd);
+		return;
+	}
+
+	if (strncmp(cmd, "import", 6) == 0) {
+		editor_import(e, cmd);
+		return;
+	}
+
+	if (strncmp(cmd, "stats", INPUT_BUF_SIZE) == 0) {
+		editor_stats(e);
+		return;
+	}
+
+	if (strncmp(cmd, "checkpoint", 10) == 0) {
+		editor_checkpoint(e, cmd);
+		return;
+	}
+
+	if (strncmp(cmd, "revert", 6) == 0) {
+		editor_revert(e, cmd);
+		return;
+	}
+
 	// Check if we want to set an option at runtime. The first three bytes are
 	// checked first, then the rest is parsed.
 	if (strncmp(cmd, "set", 3) == 0) {
@@ -849,7 +3112,8 @@ void editor_process_command(struct editor* e, const char* cmd) {
 			int octets = clampi(setval, 16, 64);
 
 			clear_screen();
-			int offset = editor_offset_at_cursor(e);
+			e->full_redraw = true;
+			size_t offset = editor_offset_at_cursor(e);
 			e->octets_per_line = octets;
 			editor_scroll_to_offset(e, offset);
 
@@ -862,6 +3126,7 @@ void editor_process_command(struct editor* e, const char* cmd) {
 		if (strcmp(setcmd, "grouping") == 0 || strcmp(setcmd, "g") == 0) {
 			int grouping = clampi(setval, 4, 16);
 			clear_screen();
+			e->full_redraw = true;
 			e->grouping = grouping;
 
 			editor_statusmessage(e, STATUS_INFO, "Byte grouping set to %d", grouping);
@@ -875,17 +3140,139 @@ void editor_process_command(struct editor* e, const char* cmd) {
 	editor_statusmessage(e, STATUS_ERROR, "Command not found: %s", cmd);
 }
 
+/*
+ * State shared between the main thread and the search worker. The worker
+ * only writes `progress', `result' and `done'; the main thread only
+ * writes `cancel'. No other editor state is touched by the worker, and
+ * the main thread does not read the contents while the worker runs.
+ */
+struct search_job {
+	struct content* contents;
+	char needle[INPUT_BUF_SIZE];
+	size_t needle_len;
+	enum search_direction dir;
+	size_t start; // offset the scan starts at.
+
+	volatile bool   cancel;   // main thread: request the worker to stop.
+	volatile bool   done;     // worker: scan finished (or cancelled).
+	volatile size_t progress; // worker: bytes scanned so far.
+	long long result;         // worker: offset of the hit, or -1.
+};
+
+static void* editor_search_worker(void* arg) {
+	struct search_job* job = arg;
+	struct content* c = job->contents;
+	size_t nlen = job->needle_len;
+
+	char chunk[65536];
+	job->result = -1;
+
+	if (job->dir == SEARCH_FORWARD) {
+		size_t offset = job->start;
+		while (!job->cancel && offset + nlen <= c->length) {
+			size_t got = content_read(c, offset, chunk, sizeof(chunk));
+			if (got < nlen) {
+				break;
+			}
+			char* hit = hx_memmem(chunk, got, job->needle, nlen);
+			if (hit != NULL) {
+				job->result = (long long) (offset + (hit - chunk));
+				break;
+			}
+			offset += got - (nlen - 1);
+			job->progress = offset - job->start;
+		}
+	} else {
+		size_t end = job->start;
+		if (end + nlen > c->length) {
+			end = c->length - nlen;
+		}
+		for (;;) {
+			if (job->cancel) {
+				break;
+			}
+			size_t start = end + nlen >= sizeof(chunk)
+				? end + nlen - sizeof(chunk) : 0;
+			size_t got = content_read(c, start, chunk, end - start + nlen);
+			char* hit = hx_memrmem(chunk, got, job->needle, nlen);
+			if (hit != NULL) {
+				job->result = (long long) (start + (hit - chunk));
+				break;
+			}
+			job->progress += end - start + 1;
+			if (start == 0) {
+				break;
+			}
+			end = start - 1;
+		}
+	}
+
+	job->done = true;
+	return NULL;
+}
+
+/*
+ * Runs a search on a worker thread, keeping the status line updated with
+ * the percentage scanned and allowing ESC to cancel. Returns the offset
+ * of the hit, or -1 when nothing was found or the search was cancelled.
+ */
+static long long editor_search_threaded(struct editor* e, const char* needle,
+                                        size_t needle_len, enum search_direction dir,
+                                        size_t start) {
+	struct search_job job;
+	memset(&job, 0, sizeof(job));
+	job.contents = e->contents;
+	memcpy(job.needle, needle, needle_len);
+	job.needle_len = needle_len;
+	job.dir = dir;
+	job.start = start;
+	job.result = -1;
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, editor_search_worker, &job) != 0) {
+		// Could not spawn a worker; do the search inline instead.
+		return dir == SEARCH_FORWARD
+			? content_search_forward(e->contents, needle, needle_len, start)
+			: content_search_backward(e->contents, needle, needle_len, start);
+	}
+
+	// The total amount of bytes the worker is going to scan, for the
+	// percentage in the status line.
+	size_t total = dir == SEARCH_FORWARD
+		? e->contents->length - start : start + needle_len;
+
+	while (!job.done) {
+		if (key_available(100)) {
+			if (read_key() == KEY_ESC) {
+				job.cancel = true;
+			}
+		}
+		int pct = total > 0 ? (int) (job.progress * 100 / total) : 100;
+		editor_statusmessage(e, STATUS_INFO, "Searching... %d%% (ESC to cancel)", pct);
+		editor_draw_statusline(e);
+	}
+	pthread_join(thread, NULL);
+
+	if (job.cancel) {
+		editor_statusmessage(e, STATUS_WARNING, "Search cancelled");
+		return -2;
+	}
+	return job.result;
+}
+
 void editor_process_search(struct editor* e, const char* str, enum search_direction dir) {
 	// Empty search string, reset the searchstr to an empty one and
 	// stops searching anything.
 	if (strncmp(str, "", INPUT_BUF_SIZE) == 0) {
 		strncpy(e->searchstr, str, INPUT_BUF_SIZE);
+		editor_matches_clear(e);
 		return;
 	}
 
 	// new search query, update searchstr.
 	if (strncmp(str, e->searchstr, INPUT_BUF_SIZE) != 0) {
 		strncpy(e->searchstr, str, INPUT_BUF_SIZE);
+		editor_matches_clear(e);
 	}
 
 	// if we are already at the beginning of the file, no use for searching
@@ -934,39 +3321,73 @@ void editor_process_search(struct editor* e, const char* str, enum search_direct
 		return;
 	}
 
-	unsigned int current_offset = editor_offset_at_cursor(e);
+	size_t current_offset = editor_offset_at_cursor(e);
 	bool found = false;
-	if (dir == SEARCH_FORWARD) {
-		current_offset++;
-		for (; current_offset < e->content_length; current_offset++) {
-			if (memcmp(e->contents + current_offset,
-				   parsedstr->contents, parsedstr->len) == 0) {
-				editor_statusmessage(e, STATUS_INFO, "");
-				editor_scroll_to_offset(e, current_offset);
-				found = true;
-				break;
+	long long match = -1;
+	bool threaded = e->contents->length >= SEARCH_THREAD_THRESHOLD;
+
+	// On buffers small enough to scan once up front, build the index of
+	// all occurrences for a new query. Repeated n/N presses then jump
+	// through the index instead of rescanning from the cursor.
+	if (!e->matches.valid && !threaded) {
+		editor_matches_build(e, parsedstr->contents, parsedstr->len);
+	}
+	if (e->matches.valid) {
+		if (dir == SEARCH_FORWARD) {
+			size_t r = editor_matches_rank(e, current_offset);
+			if (r < e->matches.count) {
+				match = e->matches.offsets[r];
 			}
-		}
-	} else if (dir == SEARCH_BACKWARD) {
-		// Decrement the offset once, or else we keep comparing the current offset
-		// position with an already found string, keeping us in the same position.
-		current_offset--;
-
-		// Since we are working with unsigned integers, do this trick in the for-statement
-		// to 'include' the zero offset with comparing.
-		for (; current_offset-- != 0; ) {
-			if (memcmp(e->contents + current_offset,
-				   parsedstr->contents, parsedstr->len) == 0) {
-				editor_statusmessage(e, STATUS_INFO, "");
-				editor_scroll_to_offset(e, current_offset);
-				found = true;
-				break;
+		} else if (current_offset > 0) {
+			size_t r = editor_matches_rank(e, current_offset - 1);
+			if (r > 0) {
+				match = e->matches.offsets[r - 1];
 			}
 		}
+
+		if (match >= 0) {
+			editor_statusmessage(e, STATUS_INFO, "");
+			editor_scroll_to_offset(e, match);
+			found = true;
+		}
+
+		charbuf_free(parsedstr);
+		if (!found) editor_statusmessage(e, STATUS_WARNING,
+						 "String not found: '%s'", str);
+		return;
+	}
+
+	if (dir == SEARCH_FORWARD) {
+		if (threaded) {
+			match = editor_search_threaded(e, parsedstr->contents,
+						       parsedstr->len, dir, current_offset + 1);
+		} else {
+			match = content_search_forward(e->contents, parsedstr->contents,
+						       parsedstr->len, current_offset + 1);
+		}
+	} else if (dir == SEARCH_BACKWARD && current_offset > 0) {
+		// Start one before the current offset, or else we keep comparing
+		// the current offset position with an already found string,
+		// keeping us in the same position.
+		if (threaded) {
+			match = editor_search_threaded(e, parsedstr->contents,
+						       parsedstr->len, dir, current_offset - 1);
+		} else {
+			match = content_search_backward(e->contents, parsedstr->contents,
+							parsedstr->len, current_offset - 1);
+		}
+	}
+
+	if (match >= 0) {
+		editor_statusmessage(e, STATUS_INFO, "");
+		editor_scroll_to_offset(e, match);
+		found = true;
 	}
 
 	charbuf_free(parsedstr);
-	if (!found) editor_statusmessage(e, STATUS_WARNING,
+	// match == -2 means the search was cancelled; the status line
+	// already says so.
+	if (!found && match != -2) editor_statusmessage(e, STATUS_WARNING,
 					 "String not found: '%s'", str);
 }
 
@@ -1111,24 +3532,182 @@ int editor_read_string(struct editor* e, char* dst, int len) {
 }
 
 
+/*
+ * Reads the selected bytes into a freshly allocated buffer. The caller
+ * owns the result. Used to stash the bytes a selection operation is about
+ * to destroy into an undo record or the yank buffer.
+ */
+static unsigned char* editor_selection_read(struct editor* e, size_t start, size_t len) {
+	unsigned char* bytes = malloc(len);
+	if (bytes == NULL) {
+		perror("Unable to allocate selection bytes");
+		exit(1);
+	}
+	content_read(e->contents, start, (char*) bytes, len);
+	return bytes;
+}
+
+/*
+ * Deletes the selected range and leaves select mode. The cut is one
+ * splice of the piece table and one span undo record, so its cost does
+ * not depend on the amount of bytes selected.
+ */
+static void editor_selection_delete(struct editor* e) {
+	size_t start;
+	size_t end;
+	editor_selection(e, &start, &end);
+	size_t len = end - start;
+
+	unsigned char* bytes = editor_selection_read(e, start, len);
+	editor_delete_span_at_offset(e, start, len);
+	action_list_add_span(e->undo_list, ACTION_DELETE, start, bytes, len);
+
+	editor_setmode(e, MODE_NORMAL);
+
+	// The cut may have contained the end of the file; keep the cursor on
+	// a byte that still exists.
+	size_t offset = start;
+	if (offset >= e->contents->length && offset > 0) {
+		offset = e->contents->length - 1;
+	}
+	editor_scroll_to_offset(e, offset);
+
+	editor_statusmessage(e, STATUS_INFO, "Deleted %llu byte(s) at offset %09llx",
+			(unsigned long long) len, (unsigned long long) start);
+}
+
+/*
+ * Overwrites the selected range with copies of byte `x' and leaves select
+ * mode. Like the delete, one splice and one span undo record.
+ */
+static void editor_selection_fill(struct editor* e, char x) {
+	size_t start;
+	size_t end;
+	editor_selection(e, &start, &end);
+	size_t len = end - start;
+
+	unsigned char* prev = editor_selection_read(e, start, len);
+	editor_fill_span_at_offset(e, start, len, x);
+	action_list_add_span(e->undo_list, ACTION_REPLACE, start, prev, len);
+
+	editor_setmode(e, MODE_NORMAL);
+	editor_scroll_to_offset(e, start);
+	editor_statusmessage(e, STATUS_INFO, "Filled %llu byte(s) at offset %09llx with %02x",
+			(unsigned long long) len, (unsigned long long) start, (unsigned char) x);
+}
+
+/*
+ * Copies the selected range into the yank buffer and leaves select mode.
+ */
+static void editor_selection_yank(struct editor* e) {
+	size_t start;
+	size_t end;
+	editor_selection(e, &start, &end);
+	size_t len = end - start;
+
+	free(e->yank);
+	e->yank = editor_selection_read(e, start, len);
+	e->yank_len = len;
+
+	editor_setmode(e, MODE_NORMAL);
+	editor_statusmessage(e, STATUS_INFO, "Yanked %llu byte(s) at offset %09llx",
+			(unsigned long long) len, (unsigned long long) start);
+}
+
+/*
+ * Inserts the yank buffer at the cursor, or after it when `after' is set:
+ * one splice and one span undo record, however large the yank is.
+ */
+static void editor_put(struct editor* e, bool after) {
+	if (e->yank == NULL || e->yank_len == 0) {
+		editor_statusmessage(e, STATUS_WARNING, "Nothing to put");
+		return;
+	}
+
+	size_t offset = editor_offset_at_cursor(e);
+	if (after && e->contents->length) {
+		offset++;
+	}
+
+	editor_insert_span_at_offset(e, offset, e->yank, e->yank_len);
+
+	// The undo record owns its bytes, so it gets a copy; the yank buffer
+	// stays usable for the next put.
+	unsigned char* bytes = malloc(e->yank_len);
+	if (bytes == NULL) {
+		perror("Unable to allocate put bytes");
+		exit(1);
+	}
+	memcpy(bytes, e->yank, e->yank_len);
+	action_list_add_span(e->undo_list, ACTION_INSERT, offset, bytes, e->yank_len);
+
+	editor_scroll_to_offset(e, offset + e->yank_len - 1);
+	editor_statusmessage(e, STATUS_INFO, "Put %llu byte(s) at offset %09llx",
+			(unsigned long long) e->yank_len, (unsigned long long) offset);
+}
+
 void editor_process_keypress(struct editor* e) {
 	if (e->mode & (MODE_INSERT | MODE_APPEND)) {
+		bool after = e->mode & MODE_APPEND;
 		char out = 0;
-		if (editor_read_hex_input(e, &out) != -1) {
-			editor_insert_byte(e, out, e->mode & MODE_APPEND);
+		if (editor_read_hex_input(e, &out) == -1) {
+			return;
+		}
+
+		// Drain input that is already waiting (a paste): consume complete
+		// hex pairs into one batch, so the paste becomes a single splice
+		// and a single undo record instead of a cycle per byte. Anything
+		// past the batch size is picked up on the next iteration.
+		char batch[1024];
+		size_t batchlen = 0;
+		batch[batchlen++] = out;
+		while (batchlen < sizeof(batch) && key_available(0)) {
+			if (editor_read_hex_input(e, &out) != -1) {
+				batch[batchlen++] = out;
+			} else if (!(e->mode & (MODE_INSERT | MODE_APPEND))) {
+				// ESC ended the mode mid-batch.
+				break;
+			}
+		}
+
+		editor_insert_bytes(e, batch, batchlen, after);
+		if (batchlen == 1) {
 			editor_move_cursor(e, KEY_RIGHT, 1);
+		} else {
+			// A batch can span rows, which editor_move_cursor does not
+			// handle; jump straight past the inserted span.
+			editor_scroll_to_offset(e, editor_offset_at_cursor(e) + batchlen);
 		}
 		return;
 	}
 
 	// Append or insert 'literal' ASCII values.
 	if (e->mode & (MODE_INSERT_ASCII | MODE_APPEND_ASCII)) {
+		bool after = e->mode & MODE_APPEND_ASCII;
 		char c = read_key();
 		if (c == KEY_ESC) {
 			editor_setmode(e, MODE_NORMAL); return;
 		}
-		editor_insert_byte(e, c, e->mode & MODE_APPEND_ASCII);
-		editor_move_cursor(e, KEY_RIGHT, 1);
+
+		// As above: batch whatever is already waiting into one insert.
+		char batch[1024];
+		size_t batchlen = 0;
+		batch[batchlen++] = c;
+		while (batchlen < sizeof(batch) && key_available(0)) {
+			c = read_key();
+			if (c == KEY_ESC) {
+				editor_setmode(e, MODE_NORMAL);
+				break;
+			}
+			batch[batchlen++] = c;
+		}
+
+		editor_insert_bytes(e, batch, batchlen, after);
+		if (batchlen == 1) {
+			editor_move_cursor(e, KEY_RIGHT, 1);
+		} else {
+			editor_scroll_to_offset(e, editor_offset_at_cursor(e) + batchlen);
+		}
 		return;
 	}
 
@@ -1139,7 +3718,7 @@ void editor_process_keypress(struct editor* e) {
 			return;
 		}
 
-		if (e->content_length > 0) {
+		if (e->contents->length > 0) {
 			editor_replace_byte(e, c);
 		} else {
 			editor_statusmessage(e, STATUS_ERROR, "File is empty, nothing to replace");
@@ -1149,7 +3728,7 @@ void editor_process_keypress(struct editor* e) {
 
 	if (e->mode & MODE_REPLACE) {
 		char out = 0;
-		if (e->content_length > 0) {
+		if (e->contents->length > 0) {
 			if (editor_read_hex_input(e, &out) != -1) {
 				editor_replace_byte(e, out);
 			}
@@ -1192,6 +3771,70 @@ void editor_process_keypress(struct editor* e) {
 	case KEY_CTRL_S: editor_writefile(e); return;
 	}
 
+	// Handle keys while a selection is active. Movement grows or shrinks
+	// the selection; the operations below act on it as one span.
+	if (e->mode & MODE_SELECT) {
+		switch (c) {
+		case KEY_UP:
+		case KEY_DOWN:
+		case KEY_RIGHT:
+		case KEY_LEFT: editor_move_cursor(e, c, 1); break;
+
+		case 'h': editor_move_cursor(e, KEY_LEFT,  1); break;
+		case 'j': editor_move_cursor(e, KEY_DOWN,  1); break;
+		case 'k': editor_move_cursor(e, KEY_UP,    1); break;
+		case 'l': editor_move_cursor(e, KEY_RIGHT, 1); break;
+
+		case 'b': editor_move_cursor(e, KEY_LEFT, e->grouping); break;
+		case 'w': editor_move_cursor(e, KEY_RIGHT, e->grouping); break;
+
+		case KEY_HOME: e->cursor_x = 1; break;
+		case KEY_END:  editor_move_cursor(e, KEY_RIGHT, e->octets_per_line - e->cursor_x); break;
+
+		case 'G':
+			editor_scroll(e, e->contents->length);
+			editor_cursor_at_offset(e, e->contents->length-1, &e->cursor_x, &e->cursor_y);
+			break;
+		case 'g':
+			c = read_key();
+			if (c == 'g') {
+				e->line = 0;
+				editor_cursor_at_offset(e, 0, &e->cursor_x, &e->cursor_y);
+			}
+			break;
+
+		case KEY_DEL:
+		case 'x':
+		case 'd': editor_selection_delete(e); return;
+		case 'y': editor_selection_yank(e);   return;
+		case 'z': editor_selection_fill(e, 0); return;
+		case 'f': {
+			// Read the fill byte as two hex chars, like replace mode
+			// does. ESC drops back to normal mode and cancels.
+			char out = 0;
+			while (editor_read_hex_input(e, &out) == -1) {
+				if (!(e->mode & MODE_SELECT)) {
+					return;
+				}
+			}
+			editor_selection_fill(e, out);
+			return;
+		}
+
+		default: return;
+		}
+
+		// The selection tracks the cursor, so any movement may change the
+		// highlight on many rows at once.
+		e->full_redraw = true;
+		size_t start;
+		size_t end;
+		editor_selection(e, &start, &end);
+		editor_statusmessage(e, STATUS_INFO, "-- SELECT -- %llu byte(s)",
+				(unsigned long long) (end - start));
+		return;
+	}
+
 	// Handle commands when in normal mode.
 	if (e->mode & MODE_NORMAL) {
 		switch (c) {
@@ -1211,6 +3854,8 @@ void editor_process_keypress(struct editor* e) {
 		case 'x': editor_delete_char_at_cursor(e); break;
 		case 'n': editor_process_search(e, e->searchstr, SEARCH_FORWARD); break;
 		case 'N': editor_process_search(e, e->searchstr, SEARCH_BACKWARD); break;
+		case 'd': editor_diff_jump(e, 1); break;
+		case 'D': editor_diff_jump(e, -1); break;
 
 		case 'a': editor_setmode(e, MODE_APPEND);       return;
 		case 'A': editor_setmode(e, MODE_APPEND_ASCII); return;
@@ -1221,6 +3866,18 @@ void editor_process_keypress(struct editor* e) {
 		case ':': editor_setmode(e, MODE_COMMAND);      return;
 		case '/': editor_setmode(e, MODE_SEARCH);       return;
 
+		case 'v':
+			if (e->contents->length <= 0) {
+				editor_statusmessage(e, STATUS_WARNING, "File is empty, nothing to select");
+				return;
+			}
+			e->sel_anchor = editor_offset_at_cursor(e);
+			editor_setmode(e, MODE_SELECT);
+			return;
+
+		case 'p': editor_put(e, true);  return;
+		case 'P': editor_put(e, false); return;
+
 		case 'u':         editor_undo(e); return;
 		case KEY_CTRL_R : editor_redo(e); return;
 
@@ -1229,8 +3886,8 @@ void editor_process_keypress(struct editor* e) {
 		case 'w': editor_move_cursor(e, KEY_RIGHT, e->grouping); break;
 		case 'G':
 			// Scroll to the end, place the cursor at the end.
-			editor_scroll(e, e->content_length);
-			editor_cursor_at_offset(e, e->content_length-1, &e->cursor_x, &e->cursor_y);
+			editor_scroll(e, e->contents->length);
+			editor_cursor_at_offset(e, e->contents->length-1, &e->cursor_x, &e->cursor_y);
 			break;
 		case 'g':
 			// Read extra keypress
@@ -1254,6 +3911,124 @@ void editor_process_keypress(struct editor* e) {
 	}
 }
 
+/*
+ * Applies a span of bytes as one insert splice, for undo/redo of a whole
+ * action record. Multi-byte spans invalidate the match index, since its
+ * incremental updates only handle single-byte shifts.
+ */
+static void editor_insert_span_at_offset(struct editor* e, size_t offset,
+		const unsigned char* bytes, size_t len) {
+	content_insert(e->contents, offset, (const char*) bytes, len);
+	if (len == 1) {
+		editor_matches_edit(e, offset, 1);
+	} else {
+		editor_matches_clear(e);
+	}
+	editor_stats_invalidate(e);
+	ascii_cache_invalidate();
+	e->dirty = true;
+	e->full_redraw = true;
+	e->dirty_ranges.track = false;
+}
+
+/*
+ * As editor_insert_span_at_offset, but deleting the span.
+ */
+static void editor_delete_span_at_offset(struct editor* e, size_t offset, size_t len) {
+	content_delete(e->contents, offset, len);
+	if (len == 1) {
+		editor_matches_edit(e, offset, -1);
+	} else {
+		editor_matches_clear(e);
+	}
+	editor_stats_invalidate(e);
+	ascii_cache_invalidate();
+	e->dirty = true;
+	e->full_redraw = true;
+	e->dirty_ranges.track = false;
+}
+
+/*
+ * Swaps a span of the contents with the bytes stored in an action record:
+ * the stored bytes are written to the buffer, and the bytes they replace
+ * are stored back into `bytes'. Undoing and redoing a replace both come
+ * down to this same swap.
+ */
+static void editor_replace_span_at_offset(struct editor* e, size_t offset,
+		unsigned char* bytes, size_t len) {
+	if (len == 1) {
+		unsigned char cur = content_byte_at(e->contents, offset);
+		content_replace_byte(e->contents, offset, bytes[0]);
+		bytes[0] = cur;
+		editor_matches_edit(e, offset, 0);
+	} else {
+		// One read and one splice instead of a piece split per byte, so
+		// undoing a filled selection costs the same as making it.
+		unsigned char* cur = malloc(len);
+		if (cur == NULL) {
+			perror("Unable to allocate replace span");
+			exit(1);
+		}
+		content_read(e->contents, offset, (char*) cur, len);
+		content_replace(e->contents, offset, (const char*) bytes, len);
+		memcpy(bytes, cur, len);
+		free(cur);
+		editor_matches_clear(e);
+	}
+	editor_stats_edit(e, offset, len);
+	ascii_cache_invalidate();
+	e->dirty = true;
+	e->full_redraw = true;
+	editor_dirty_mark(e, offset, len);
+}
+
+/*
+ * Overwrites a span with copies of one byte as a single content_fill
+ * splice, for the selection fill and zero operations.
+ */
+static void editor_fill_span_at_offset(struct editor* e, size_t offset, size_t len, char x) {
+	content_fill(e->contents, offset, len, x);
+	editor_matches_clear(e);
+	editor_stats_edit(e, offset, len);
+	ascii_cache_invalidate();
+	e->dirty = true;
+	e->full_redraw = true;
+	editor_dirty_mark(e, offset, len);
+}
+
+/*
+ * Swaps the span an ACTION_REWRITE record covers with the bytes it
+ * stores: the record's span goes into the buffer, the buffer's span
+ * (whose length may differ) into the record. Undoing and redoing a
+ * replace-all both come down to this same swap.
+ */
+static void editor_rewrite_span_at_offset(struct editor* e, struct action* action) {
+	size_t cur_len = action->buf_len;
+	unsigned char* cur = malloc(cur_len > 0 ? cur_len : 1);
+	if (cur == NULL) {
+		perror("Unable to allocate rewrite span");
+		exit(1);
+	}
+	content_read(e->contents, action->offset, (char*) cur, cur_len);
+
+	content_delete(e->contents, action->offset, cur_len);
+	content_insert(e->contents, action->offset, (const char*) action->bytes, action->len);
+
+	free(action->bytes);
+	action->bytes = cur;
+	action->buf_len = action->len;
+	action->len = cur_len;
+	action->cap = cur_len;
+
+	editor_matches_clear(e);
+	editor_stats_invalidate(e);
+	ascii_cache_invalidate();
+	e->dirty = true;
+	e->full_redraw = true;
+	// The swap shifts every byte after the span.
+	e->dirty_ranges.track = false;
+}
+
 void editor_undo(struct editor* e) {
 	struct action* last_action = e->undo_list->curr;
 
@@ -1268,21 +4043,23 @@ void editor_undo(struct editor* e) {
 		return;
 	}
 
-	// Save the old contents in case we're undoing a replace.
-	char old_contents = e->contents[last_action->offset];
 	switch (last_action->act) {
 	case ACTION_APPEND:
-		editor_delete_char_at_offset(e, last_action->offset+1);
+		editor_delete_span_at_offset(e, last_action->offset + 1, last_action->len);
 		break;
 	case ACTION_DELETE:
-		editor_insert_byte_at_offset(e, last_action->offset, last_action->c, false);
+		editor_insert_span_at_offset(e, last_action->offset, last_action->bytes, last_action->len);
 		break;
 	case ACTION_REPLACE:
-		e->contents[last_action->offset] = last_action->c;
-		last_action->c = old_contents;
+		// Swaps the stored bytes with the current ones, so redoing the
+		// replace is the same swap again.
+		editor_replace_span_at_offset(e, last_action->offset, last_action->bytes, last_action->len);
 		break;
 	case ACTION_INSERT:
-		editor_delete_char_at_offset(e, last_action->offset);
+		editor_delete_span_at_offset(e, last_action->offset, last_action->len);
+		break;
+	case ACTION_REWRITE:
+		editor_rewrite_span_at_offset(e, last_action);
 		break;
 	}
 
@@ -1293,10 +4070,10 @@ void editor_undo(struct editor* e) {
 	action_list_move(e->undo_list, -1);
 
 	editor_statusmessage(e, STATUS_INFO,
-		"Reverted '%s' at offset %d to byte '%02x' (%d left)",
+		"Reverted '%s' of %zu byte(s) at offset %lld (%d left)",
 			action_type_name(last_action->act),
-			last_action->offset,
-			last_action->c,
+			last_action->len,
+			(long long) last_action->offset,
 			action_list_curr_pos(e->undo_list));
 }
 
@@ -1321,21 +4098,21 @@ void editor_redo(struct editor* e) {
 		return;
 	}
 
-	// Save the old contents in case we're redoing a replace.
-	char old_contents = e->contents[next_action->offset];
 	switch (next_action->act) {
 	case ACTION_APPEND:
-		editor_insert_byte_at_offset(e, next_action->offset, next_action->c, true);
+		editor_insert_span_at_offset(e, next_action->offset + 1, next_action->bytes, next_action->len);
 		break;
 	case ACTION_DELETE:
-		editor_delete_char_at_offset(e, next_action->offset);
+		editor_delete_span_at_offset(e, next_action->offset, next_action->len);
 		break;
 	case ACTION_REPLACE:
-		e->contents[next_action->offset] = next_action->c;
-		next_action->c = old_contents;
+		editor_replace_span_at_offset(e, next_action->offset, next_action->bytes, next_action->len);
 		break;
 	case ACTION_INSERT:
-		editor_insert_byte_at_offset(e, next_action->offset, next_action->c, false);
+		editor_insert_span_at_offset(e, next_action->offset, next_action->bytes, next_action->len);
+		break;
+	case ACTION_REWRITE:
+		editor_rewrite_span_at_offset(e, next_action);
 		break;
 	}
 
@@ -1346,10 +4123,10 @@ void editor_redo(struct editor* e) {
 	action_list_move(e->undo_list, 1);
 
 	editor_statusmessage(e, STATUS_INFO,
-		"Redone '%s' at offset %d to byte '%02x' (%d left)",
+		"Redone '%s' of %zu byte(s) at offset %lld (%d left)",
 			action_type_name(next_action->act),
-			next_action->offset,
-			next_action->c,
+			next_action->len,
+			(long long) next_action->offset,
 			action_list_size(e->undo_list)
 			- action_list_curr_pos(e->undo_list));
 }
@@ -1366,10 +4143,13 @@ struct editor* editor_init() {
 	e->line = 0;
 	e->cursor_x = 1;
 	e->cursor_y = 1;
+	e->prev_cursor_y = 1;
+	e->dirty_row = 0;
+	e->full_redraw = true;
 	e->filename = NULL;
 	e->contents = NULL;
-	e->content_length = 0;
 	e->dirty = false;
+	e->prefer_mmap = false;
 
 	memset(e->status_message, '\0', sizeof(e->status_message));
 
@@ -1378,7 +4158,20 @@ struct editor* editor_init() {
 	memset(e->inputbuffer, '\0', sizeof(e->inputbuffer));
 	e->inputbuffer_index = 0;
 
+	e->sel_anchor = 0;
+	e->yank = NULL;
+	e->yank_len = 0;
+
+	e->checkpoints = NULL;
+	e->save_count = 0;
+
 	memset(e->searchstr, '\0', sizeof(e->searchstr));
+	memset(&e->matches, 0, sizeof(e->matches));
+	memset(&e->dirty_ranges, 0, sizeof(e->dirty_ranges));
+	e->dirty_ranges.track = true;
+	memset(&e->diffs, 0, sizeof(e->diffs));
+	memset(&e->stats, 0, sizeof(e->stats));
+	memset(&e->perf, 0, sizeof(e->perf));
 
 	get_window_size(&(e->screen_rows), &(e->screen_cols));
 
@@ -1389,7 +4182,22 @@ struct editor* editor_init() {
 
 void editor_free(struct editor* e) {
 	action_list_free(e->undo_list);
+	struct checkpoint* cp = e->checkpoints;
+	while (cp != NULL) {
+		struct checkpoint* next = cp->next;
+		content_snapshot_free(cp->snap);
+		free(cp);
+		cp = next;
+	}
+	free(e->yank);
+	free(e->matches.offsets);
+	free(e->dirty_ranges.ranges);
+	free(e->diffs.ranges);
+	free(e->stats.hist);
+	free(e->stats.entropy);
 	free(e->filename);
-	free(e->contents);
+	if (e->contents != NULL) {
+		content_free(e->contents);
+	}
 	free(e);
 }
@@ -8,8 +8,10 @@
 #define HX_EDITOR_H
 
 #include "charbuf.h"
+#include "content.h"
 #include "thingy.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  * Mode the editor can be in.
@@ -24,6 +26,7 @@ enum editor_mode {
 	MODE_REPLACE       = 1 << 6, // replace values at cursor position.
 	MODE_COMMAND       = 1 << 7, // command input mode.
 	MODE_SEARCH        = 1 << 8, // search mode.
+	MODE_SELECT        = 1 << 9, // visual selection of a byte range.
 };
 
 /*
@@ -45,6 +48,111 @@ enum status_severity {
 
 #define INPUT_BUF_SIZE 80
 
+/*
+ * Index of every occurrence of the current search string. Built once per
+ * query so repeated n/N presses jump via a lookup instead of rescanning
+ * the buffer, and so the render path can highlight every visible match.
+ * Edits update the index incrementally: offsets shift on inserts and
+ * deletes, and matches overlapping an edited byte are dropped.
+ */
+struct match_index {
+	size_t* offsets;    // sorted start offsets of every match.
+	size_t  count;      // amount of matches.
+	size_t  cap;        // capacity of the offsets array.
+	size_t  needle_len; // length of the needle that was searched.
+	bool    valid;      // whether the index reflects the current search.
+};
+
+/*
+ * One contiguous run of bytes, used by the dirty-range and diff indexes.
+ */
+struct byte_range {
+	size_t start; // first byte of the run.
+	size_t end;   // one past the last byte of the run.
+};
+
+/*
+ * Set of byte ranges modified since the last successful save, kept sorted
+ * and disjoint. Fed by replace-mode edits, so saving can flush only the
+ * bytes that actually changed since the previous save instead of every
+ * range ever patched. Inserts and deletes shift the offsets of everything
+ * after them, which makes the recorded ranges meaningless: they stop the
+ * tracking until the next save.
+ */
+struct dirty_set {
+	struct byte_range* ranges; // sorted, non-overlapping ranges.
+	size_t count;              // amount of ranges.
+	size_t cap;                // capacity of the ranges array.
+	bool   track;              // whether the set reflects all edits.
+};
+
+/*
+ * Index of the byte ranges that differ from a comparison file given with
+ * the -d command line option, kept sorted and disjoint. Computed once at
+ * open time with a blockwise comparison; offsets are positions in the
+ * file as it was opened and are not updated by edits, since the index
+ * describes the opened image against the reference image.
+ */
+struct diff_index {
+	struct byte_range* ranges; // sorted, non-overlapping differing ranges.
+	size_t count;              // amount of ranges.
+	size_t cap;                // capacity of the ranges array.
+	bool   valid;              // whether a comparison file was given.
+};
+
+/*
+ * A named checkpoint: a snapshot of the contents taken by the :checkpoint
+ * command, restorable with :revert. Snapshots copy only the piece chain,
+ * not file bytes, so keeping several around is cheap even on huge files.
+ */
+struct checkpoint {
+	char name[INPUT_BUF_SIZE];      // name the checkpoint was given.
+	struct content_snapshot* snap;  // state of the contents when taken.
+	size_t save_count;              // the editor's save count when taken.
+	struct checkpoint* next;        // next checkpoint, or NULL.
+};
+
+// Width of one byte statistics block, see struct stats. A block spans
+// 16K bytes, so its byte counts fit 16-bit bins and the counts of a
+// multi-GB image stay a few percent of its size.
+#define STATS_BLOCK (16 * 1024)
+
+/*
+ * Byte statistics over the contents (:stats): a byte histogram and the
+ * Shannon entropy per STATS_BLOCK-sized block, rendered as a sparkline
+ * column next to the ASCII pane so high-entropy (compressed, encrypted)
+ * regions stand out while scrolling. In-place edits recount only the
+ * blocks they touch; inserts and deletes shift every block after them,
+ * which invalidates the statistics until :stats is run again.
+ */
+struct stats {
+	bool enabled;           // whether the sparkline column is shown.
+	bool valid;             // whether the counts reflect the contents.
+	size_t block_count;     // amount of blocks the contents span.
+	uint16_t (*hist)[256];  // byte counts per block.
+	unsigned char* entropy; // entropy per block, 0 (0 bits) to 255 (8 bits).
+};
+
+// Amount of recent frames the performance HUD keeps for its percentiles.
+#define PERF_FRAMES 128
+
+/*
+ * State of the runtime performance HUD, toggled with the :perf command.
+ * Ring buffers hold the render (frame assembly) and draw (terminal
+ * write) times of the most recent frames; p50/p99 over them show whether
+ * sluggishness comes from building the frame or from the terminal link.
+ * The input time is how long handling the previous keypress took,
+ * excluding the wait for the user.
+ */
+struct perf_stats {
+	bool enabled;                     // whether the HUD is shown.
+	long long render_ns[PERF_FRAMES]; // frame assembly times.
+	long long draw_ns[PERF_FRAMES];   // terminal write times.
+	size_t pos;                       // next slot in the rings.
+	size_t count;                     // filled slots, up to PERF_FRAMES.
+	long long input_ns;               // handling time of the last keypress.
+};
+
 /*
  * This struct contains internal information of the state of the editor.
  */
@@ -52,18 +160,22 @@ struct editor {
 	int octets_per_line; // Amount of octets (bytes) per line. Ideally multiple of 2.
 	int grouping;        // Amount of bytes per group. Ideally multiple of 2.
 
-	int line;        // The 'line' in the editor. Used for scrolling.
+	long long line;  // The 'line' in the editor. Used for scrolling.
 	int cursor_x;    // Cursor x pos on the current screen
 	int cursor_y;    // Cursor y pos on the current screen
 	int screen_rows; // amount of screen rows after init
 	int screen_cols; // amount of screen columns after init
 
+	int  prev_cursor_y; // cursor row at the previous refresh.
+	int  dirty_row;     // row edited since the previous refresh, or 0 if none.
+	bool full_redraw;   // when set, the next refresh redraws every row.
+
 	enum editor_mode mode; // mode the editor is in
 
-	bool         dirty;          // whether the buffer is modified
-	char*        filename;       // the filename currently open
-	char*        contents;       // the file's contents
-	unsigned int content_length; // length of the contents
+	bool            dirty;       // whether the buffer is modified
+	bool            prefer_mmap; // mmap files regardless of their size (-m)
+	char*           filename;    // the filename currently open
+	struct content* contents;    // the file's contents, as a piece table
 
 	enum status_severity status_severity;     // status severity
 	char                 status_message[120]; // status message
@@ -74,6 +186,29 @@ struct editor {
 
 	char searchstr[INPUT_BUF_SIZE]; // the current search string or NULL if none.
 
+	size_t sel_anchor; // offset the selection was started at (MODE_SELECT).
+
+	unsigned char* yank; // bytes of the last yanked selection, or NULL.
+	size_t yank_len;     // amount of yanked bytes.
+
+	struct match_index matches; // all occurrences of the current search string.
+
+	struct checkpoint* checkpoints; // named snapshots (:checkpoint), or NULL.
+
+	// Amount of successful saves so far. Checkpoints remember the count
+	// they were taken at: reverting across a save means the disk was
+	// flushed from a state the restored chain knows nothing about, so
+	// the in-place save paths are no longer safe.
+	size_t save_count;
+
+	struct dirty_set dirty_ranges; // byte ranges modified since the last save.
+
+	struct diff_index diffs; // byte ranges differing from the -d comparison file.
+
+	struct stats stats; // byte histogram and block entropy (:stats).
+
+	struct perf_stats perf; // performance HUD state (:perf).
+
 	struct action_list* undo_list; // tail of the list
 	struct thingy_table* thingies; // thingy table or NULL if none.
 };
@@ -90,7 +225,7 @@ struct editor* editor_init();
  *
  * Note that this function will NOT scroll the editor to the proper line.
  */
-void editor_cursor_at_offset(struct editor* e, int offset, int* x, int *y);
+void editor_cursor_at_offset(struct editor* e, size_t offset, int* x, int *y);
 
 /*
  * Deletes the character (byte) at the current cursor position (in other
@@ -98,7 +233,15 @@ void editor_cursor_at_offset(struct editor* e, int offset, int* x, int *y);
  */
 void editor_delete_char_at_cursor(struct editor* e);
 
-void editor_delete_char_at_offset(struct editor* e, unsigned int offset);
+void editor_delete_char_at_offset(struct editor* e, size_t offset);
+
+/*
+ * Compares the opened contents against the file denoted by `filename'
+ * (the -d command line option) and fills the diff index with the byte
+ * ranges that differ. Large files are compared blockwise on multiple
+ * threads. Exits when the comparison file cannot be opened.
+ */
+void editor_diff_build(struct editor* e, const char* filename);
 
 void editor_free(struct editor* e);
 
@@ -114,7 +257,7 @@ void editor_insert_byte(struct editor* e, char x, bool after);
  * Inserts the character byte at the given offset, or after the given offset if
  * `after' is set to true.
  */
-void editor_insert_byte_at_offset(struct editor* e, unsigned int offset, char x, bool after);
+void editor_insert_byte_at_offset(struct editor* e, size_t offset, char x, bool after);
 
 /*
  * Moves the cursor. The terminal cursor positions are all 1-based, so we
@@ -128,7 +271,7 @@ void editor_move_cursor(struct editor* e, int dir, int amount);
 /*
  * Gets the current offset at which the cursor is.
  */
-int editor_offset_at_cursor(struct editor* e);
+size_t editor_offset_at_cursor(struct editor* e);
 
 /*
  * Opens a file denoted by `filename', or exit if the file cannot be opened.
@@ -203,7 +346,7 @@ int editor_read_string(struct editor* e, char* dst, int len);
  * selected byte with a different color in the ASCII row to easily identify
  * which byte is being highlighted.
  */
-void editor_render_ascii(struct editor* e, int rownum, unsigned int start_offset, struct charbuf* b);
+void editor_render_ascii(struct editor* e, int rownum, size_t start_offset, struct charbuf* b);
 
 /*
  * Renders the contents of the current state of the editor `e'
@@ -211,12 +354,28 @@ void editor_render_ascii(struct editor* e, int rownum, unsigned int start_offset
  */
 void editor_render_contents(struct editor* e, struct charbuf* b);
 
+/*
+ * Renders a single screen row `rownum' (1-based): the address, the hex
+ * values and the ASCII equivalents. The row is positioned with an absolute
+ * cursor movement, so a row can be re-rendered on its own when only part
+ * of the screen changed since the previous refresh.
+ */
+void editor_render_row(struct editor* e, int rownum, struct charbuf* b);
+
 /*
  * Renders on-line help on the screen. This is implemented without the
  * usage of a MODE since the commands etc. are not applicable in this state.
  */
 void editor_render_help(struct editor* e);
 
+/*
+ * Renders the performance HUD in the ruler's place at the bottom right:
+ * p50/p99 of the render and draw phases over the recent frames, the
+ * handling time of the last keypress, the current RSS and the charbuf
+ * high-water mark.
+ */
+void editor_render_perf(struct editor* e, struct charbuf* b);
+
 /*
  * Renders a ruler at the bottom right part of the screen, containing
  * the current offset in hex and in base 10, the byte at the current
@@ -244,13 +403,13 @@ void editor_replace_byte(struct editor* e, char x);
 /*
  * Replaces a byte(char) `x' at the given `offset'.
  */
-void editor_replace_byte_at_offset(struct editor* e, unsigned int offset, char x);
+void editor_replace_byte_at_offset(struct editor* e, size_t offset, char x);
 
 /*
  * Scrolls the editor by updating the `line' accordingly, within
  * the bounds of the readable parts of the buffer.
  */
-void editor_scroll(struct editor* e, int units);
+void editor_scroll(struct editor* e, long long units);
 
 /*
  * Scrolls the editor to a particular given offset. The given offset
@@ -259,7 +418,7 @@ void editor_scroll(struct editor* e, int units);
  *
  * The cursor will be centered on the screen.
  */
-void editor_scroll_to_offset(struct editor* e, unsigned int offset);
+void editor_scroll_to_offset(struct editor* e, size_t offset);
 
 /*
  * Sets editor to mode to one of the modes defined in the enum.
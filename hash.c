@@ -0,0 +1,348 @@
+/*
+ * This file is part of hx - a hex editor for the terminal.
+ *
+ * Copyright (c) 2016 Kevin Pors. See LICENSE for details.
+ */
+
+#include "hash.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+// =============================================================================
+// CRC-32.
+// =============================================================================
+
+// Slice-by-8 lookup tables, built lazily on the first update. Table 0 is
+// the classic byte-at-a-time table; table `s' advances a byte `s' places
+// further, so eight table lookups consume eight input bytes at once.
+static uint32_t crc_table[8][256];
+static bool crc_table_ready = false;
+
+static void crc32_init_table() {
+	for (int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+		crc_table[0][i] = c;
+	}
+	for (int i = 0; i < 256; i++) {
+		uint32_t c = crc_table[0][i];
+		for (int s = 1; s < 8; s++) {
+			c = crc_table[0][c & 0xff] ^ (c >> 8);
+			crc_table[s][i] = c;
+		}
+	}
+	crc_table_ready = true;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len) {
+	if (!crc_table_ready) {
+		crc32_init_table();
+	}
+
+	const unsigned char* p = data;
+	crc = ~crc;
+	while (len >= 8) {
+		uint32_t lo = (uint32_t) p[0]
+		            | (uint32_t) p[1] << 8
+		            | (uint32_t) p[2] << 16
+		            | (uint32_t) p[3] << 24;
+		uint32_t hi = (uint32_t) p[4]
+		            | (uint32_t) p[5] << 8
+		            | (uint32_t) p[6] << 16
+		            | (uint32_t) p[7] << 24;
+		lo ^= crc;
+		crc = crc_table[7][lo & 0xff]
+		    ^ crc_table[6][(lo >> 8) & 0xff]
+		    ^ crc_table[5][(lo >> 16) & 0xff]
+		    ^ crc_table[4][lo >> 24]
+		    ^ crc_table[3][hi & 0xff]
+		    ^ crc_table[2][(hi >> 8) & 0xff]
+		    ^ crc_table[1][(hi >> 16) & 0xff]
+		    ^ crc_table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// =============================================================================
+// SHA-256 (FIPS 180-4).
+// =============================================================================
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_block(struct sha256_ctx* ctx, const unsigned char* p) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++) {
+		w[i] = (uint32_t) p[i * 4] << 24
+		     | (uint32_t) p[i * 4 + 1] << 16
+		     | (uint32_t) p[i * 4 + 2] << 8
+		     | (uint32_t) p[i * 4 + 3];
+	}
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = ctx->state[0];
+	uint32_t b = ctx->state[1];
+	uint32_t c = ctx->state[2];
+	uint32_t d = ctx->state[3];
+	uint32_t e = ctx->state[4];
+	uint32_t f = ctx->state[5];
+	uint32_t g = ctx->state[6];
+	uint32_t h = ctx->state[7];
+
+	for (int i = 0; i < 64; i++) {
+		uint32_t s1 = ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+		uint32_t s0 = ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	ctx->state[0] += a;
+	ctx->state[1] += b;
+	ctx->state[2] += c;
+	ctx->state[3] += d;
+	ctx->state[4] += e;
+	ctx->state[5] += f;
+	ctx->state[6] += g;
+	ctx->state[7] += h;
+}
+
+void sha256_init(struct sha256_ctx* ctx) {
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->total = 0;
+	ctx->buflen = 0;
+}
+
+void sha256_update(struct sha256_ctx* ctx, const void* data, size_t len) {
+	const unsigned char* p = data;
+	ctx->total += len;
+
+	// Top off a partially filled block from a previous update first.
+	if (ctx->buflen > 0) {
+		size_t take = sizeof(ctx->buf) - ctx->buflen;
+		if (take > len) {
+			take = len;
+		}
+		memcpy(ctx->buf + ctx->buflen, p, take);
+		ctx->buflen += take;
+		p += take;
+		len -= take;
+		if (ctx->buflen == sizeof(ctx->buf)) {
+			sha256_block(ctx, ctx->buf);
+			ctx->buflen = 0;
+		}
+	}
+	// Whole blocks are hashed straight out of the caller's chunk.
+	while (len >= sizeof(ctx->buf)) {
+		sha256_block(ctx, p);
+		p += sizeof(ctx->buf);
+		len -= sizeof(ctx->buf);
+	}
+	if (len > 0) {
+		memcpy(ctx->buf, p, len);
+		ctx->buflen = len;
+	}
+}
+
+void sha256_final(struct sha256_ctx* ctx, unsigned char digest[32]) {
+	// Pad with 0x80, zeroes, and the big-endian message length in bits.
+	uint64_t bits = ctx->total * 8;
+	unsigned char pad = 0x80;
+	sha256_update(ctx, &pad, 1);
+	unsigned char zero = 0x00;
+	while (ctx->buflen != 56) {
+		sha256_update(ctx, &zero, 1);
+	}
+	unsigned char lenbuf[8];
+	for (int i = 0; i < 8; i++) {
+		lenbuf[i] = (bits >> (56 - i * 8)) & 0xff;
+	}
+	sha256_update(ctx, lenbuf, 8);
+
+	for (int i = 0; i < 8; i++) {
+		digest[i * 4]     = (ctx->state[i] >> 24) & 0xff;
+		digest[i * 4 + 1] = (ctx->state[i] >> 16) & 0xff;
+		digest[i * 4 + 2] = (ctx->state[i] >> 8) & 0xff;
+		digest[i * 4 + 3] = ctx->state[i] & 0xff;
+	}
+}
+
+// =============================================================================
+// MD5 (RFC 1321).
+// =============================================================================
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Per-step left-rotate amounts.
+static const unsigned char md5_shift[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+// The sine-derived constants, K[i] = floor(abs(sin(i + 1)) * 2^32).
+// Computed once at first use rather than transcribed as 64 literals.
+static uint32_t md5_k[64];
+static bool md5_k_ready = false;
+
+static void md5_init_table() {
+	for (int i = 0; i < 64; i++) {
+		md5_k[i] = (uint32_t) (fabs(sin(i + 1)) * 4294967296.0);
+	}
+	md5_k_ready = true;
+}
+
+static void md5_block(struct md5_ctx* ctx, const unsigned char* p) {
+	uint32_t m[16];
+	for (int i = 0; i < 16; i++) {
+		m[i] = (uint32_t) p[i * 4]
+		     | (uint32_t) p[i * 4 + 1] << 8
+		     | (uint32_t) p[i * 4 + 2] << 16
+		     | (uint32_t) p[i * 4 + 3] << 24;
+	}
+
+	uint32_t a = ctx->state[0];
+	uint32_t b = ctx->state[1];
+	uint32_t c = ctx->state[2];
+	uint32_t d = ctx->state[3];
+
+	for (int i = 0; i < 64; i++) {
+		uint32_t f;
+		int g;
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		} else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+		} else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		} else {
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+		}
+		uint32_t temp = d;
+		d = c;
+		c = b;
+		b += ROL32(a + f + md5_k[i] + m[g], md5_shift[i]);
+		a = temp;
+	}
+
+	ctx->state[0] += a;
+	ctx->state[1] += b;
+	ctx->state[2] += c;
+	ctx->state[3] += d;
+}
+
+void md5_init(struct md5_ctx* ctx) {
+	if (!md5_k_ready) {
+		md5_init_table();
+	}
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->total = 0;
+	ctx->buflen = 0;
+}
+
+void md5_update(struct md5_ctx* ctx, const void* data, size_t len) {
+	const unsigned char* p = data;
+	ctx->total += len;
+
+	if (ctx->buflen > 0) {
+		size_t take = sizeof(ctx->buf) - ctx->buflen;
+		if (take > len) {
+			take = len;
+		}
+		memcpy(ctx->buf + ctx->buflen, p, take);
+		ctx->buflen += take;
+		p += take;
+		len -= take;
+		if (ctx->buflen == sizeof(ctx->buf)) {
+			md5_block(ctx, ctx->buf);
+			ctx->buflen = 0;
+		}
+	}
+	while (len >= sizeof(ctx->buf)) {
+		md5_block(ctx, p);
+		p += sizeof(ctx->buf);
+		len -= sizeof(ctx->buf);
+	}
+	if (len > 0) {
+		memcpy(ctx->buf, p, len);
+		ctx->buflen = len;
+	}
+}
+
+void md5_final(struct md5_ctx* ctx, unsigned char digest[16]) {
+	// Pad with 0x80, zeroes, and the little-endian message length in bits.
+	uint64_t bits = ctx->total * 8;
+	unsigned char pad = 0x80;
+	md5_update(ctx, &pad, 1);
+	unsigned char zero = 0x00;
+	while (ctx->buflen != 56) {
+		md5_update(ctx, &zero, 1);
+	}
+	unsigned char lenbuf[8];
+	for (int i = 0; i < 8; i++) {
+		lenbuf[i] = (bits >> (i * 8)) & 0xff;
+	}
+	md5_update(ctx, lenbuf, 8);
+
+	for (int i = 0; i < 4; i++) {
+		digest[i * 4]     = ctx->state[i] & 0xff;
+		digest[i * 4 + 1] = (ctx->state[i] >> 8) & 0xff;
+		digest[i * 4 + 2] = (ctx->state[i] >> 16) & 0xff;
+		digest[i * 4 + 3] = (ctx->state[i] >> 24) & 0xff;
+	}
+}
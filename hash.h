@@ -0,0 +1,50 @@
+/*
+ * This file is part of hx - a hex editor for the terminal.
+ *
+ * Copyright (c) 2016 Kevin Pors. See LICENSE for details.
+ */
+
+#ifndef HX_HASH_H
+#define HX_HASH_H
+
+#include <stdint.h>
+#include <stdlib.h> // size_t
+
+/*
+ * Streaming checksum and digest implementations backing the :crc32,
+ * :sha256 and :md5 commands. All three work incrementally on chunks fed
+ * in order, so a digest over a multi-GB mapped file streams through one
+ * small buffer and never allocates.
+ */
+
+/*
+ * Updates a CRC-32 (the zlib/PKZIP polynomial, matching the crc32 tool)
+ * with `len' bytes. Start with crc = 0 and feed chunks in order; the
+ * return value is the running checksum. A slice-by-8 table processes
+ * eight input bytes per iteration instead of one.
+ */
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len);
+
+struct sha256_ctx {
+	uint32_t state[8];
+	uint64_t total;        // total amount of bytes fed.
+	unsigned char buf[64]; // partial input block.
+	size_t buflen;
+};
+
+void sha256_init(struct sha256_ctx* ctx);
+void sha256_update(struct sha256_ctx* ctx, const void* data, size_t len);
+void sha256_final(struct sha256_ctx* ctx, unsigned char digest[32]);
+
+struct md5_ctx {
+	uint32_t state[4];
+	uint64_t total;        // total amount of bytes fed.
+	unsigned char buf[64]; // partial input block.
+	size_t buflen;
+};
+
+void md5_init(struct md5_ctx* ctx);
+void md5_update(struct md5_ctx* ctx, const void* data, size_t len);
+void md5_final(struct md5_ctx* ctx, unsigned char digest[16]);
+
+#endif // HX_HASH_H
@@ -31,6 +31,10 @@
 #define HX_VERSION "1.0.0"
 #endif
 
+// Budget of one frame: pending input keeps being applied without a
+// render until this much time has passed, then one frame is drawn.
+#define FRAME_BUDGET_NS (16 * 1000 * 1000ll)
+
 // Comp unit wide editor config.
 static struct editor* g_ec;
 
@@ -54,15 +58,19 @@ static void editor_exit() {
 static void print_help(const char* explanation) {
 	fprintf(stderr,
 	"%s"\
-	"usage: hx [-hv] [-o octets_per_line] [-g grouping_bytes] [-t thingy_file] filename\n"\
+	"usage: hx [-hmv] [-d difffile] [-o octets_per_line] [-g grouping_bytes] [-t thingy_file] filename\n"\
 	"\n"
 	"Command options:\n"
 	"    -h     Print this cruft and exits\n"
 	"    -v     Version information\n"
+	"    -m     Open the file memory-mapped, regardless of its size\n"
+	"    -d     Highlight bytes differing from this file (navigate with d/D)\n"
 	"    -o     Amount of octets per line\n"
 	"    -g     Grouping of bytes in one line\n"
 	"    -t     Tile containing thingy (substitution) tables\n"
 	"\n"
+	"A filename of - reads standard input, e.g. `zcat dump.gz | hx -'.\n"
+	"\n"
 	"Currently, both these values are advised to be a multiple of 2\n"
 	"to prevent garbled display :)\n"
 	"\n"
@@ -115,16 +123,19 @@ static void handle_term_resize(int sig) {
 static void resize_term() {
 	clear_screen();
 	get_window_size(&(g_ec->screen_rows), &(g_ec->screen_cols));
+	g_ec->full_redraw = true;
 }
 
 int main(int argc, char* argv[]) {
 	char* file = NULL;
 	char* thingy_filename = NULL;
+	char* diff_filename = NULL;
 	int octets_per_line = 16;
 	int grouping = 4;
+	bool prefer_mmap = false;
 
 	int ch = 0;
-	while ((ch = getopt(argc, argv, "vhg:o:t:")) != -1) {
+	while ((ch = getopt(argc, argv, "vhmd:g:o:t:")) != -1) {
 		switch (ch) {
 		case 'v':
 			print_version();
@@ -133,6 +144,12 @@ int main(int argc, char* argv[]) {
 			print_help("");
 			exit(0);
 			break;
+		case 'm':
+			prefer_mmap = true;
+			break;
+		case 'd':
+			diff_filename = optarg;
+			break;
 		case 'g':
 			// parse grouping
 			grouping = str2int(optarg, 2, 16, 4);
@@ -170,6 +187,7 @@ int main(int argc, char* argv[]) {
 	g_ec = editor_init();
 	g_ec->octets_per_line = octets_per_line;
 	g_ec->grouping = grouping;
+	g_ec->prefer_mmap = prefer_mmap;
 
 	if (thingy_filename) {
 		struct thingy_table* tbl = thingy_table_init();
@@ -179,6 +197,10 @@ int main(int argc, char* argv[]) {
 
 	editor_openfile(g_ec, file);
 
+	if (diff_filename) {
+		editor_diff_build(g_ec, diff_filename);
+	}
+
 	enable_raw_mode();
 	term_state_save();
 
@@ -187,7 +209,31 @@ int main(int argc, char* argv[]) {
 
 	while (true) {
 		editor_refresh_screen(g_ec);
+
+		long long t = time_ns();
 		editor_process_keypress(g_ec);
+
+		// Coalesce queued input into this frame: as long as more keys are
+		// already pending (an auto-repeated arrow, a held PgDn on a slow
+		// link), apply them too and render once, so the display always
+		// shows the latest state and the input queue can never run ahead
+		// of it. The frame budget bounds how long a steady stream of
+		// events can postpone the render.
+		while (resizeflag == 0 && key_available(0)
+				&& time_ns() - t < FRAME_BUDGET_NS) {
+			editor_process_keypress(g_ec);
+		}
+
+		// The handling time minus the time spent blocked waiting for the
+		// user is the input phase shown by the :perf HUD. The idle time
+		// is collected unconditionally so it cannot pile up while the
+		// HUD is off and skew the first measurement after enabling it.
+		long long idle = input_idle_collect();
+		if (g_ec->perf.enabled) {
+			long long input = time_ns() - t - idle;
+			g_ec->perf.input_ns = input > 0 ? input : 0;
+		}
+
 		if (resizeflag == 1) {
 			resize_term();
 			resizeflag = 0;
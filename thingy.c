@@ -12,27 +12,82 @@
 #include <stdint.h>
 
 
-struct linked_list {
+/*
+ * One multibyte sequence and its substitution. Entries hang off a hash
+ * bucket; collisions within a bucket form a short chain.
+ */
+struct thingy_entry {
 	unsigned char length;
 	unsigned char* key;
 	unsigned char* value;
-	struct linked_list* next;
+	struct thingy_entry* next; //next entry in the same bucket
 };
 
+// Initial bucket count for the multibyte hash table. Must be a power of
+// two so the hash can be masked instead of divided.
+#define THINGY_INITIAL_BUCKETS 64
+
 struct thingy_table {
 	unsigned char longest_key;
 	unsigned char* values[256]; //values for single-byte sequences
-	struct linked_list* mbseqs[256]; //linked list for mb seqs starting with each byte
+
+	// Multibyte sequences live in a hash table keyed on the full byte
+	// sequence, so the render-time lookup is O(1) regardless of how
+	// many sequences share a first byte.
+	struct thingy_entry** buckets;
+	size_t bucket_count; //always a power of two
+	size_t entry_count;  //amount of multibyte entries stored
 };
 
+/*
+ * FNV-1a over the key bytes. The key length is mixed in as well so that
+ * e.g. "AB" and "AB\x00" do not collide trivially.
+ */
+static size_t thingy_hash(unsigned char length, const unsigned char* key) {
+	uint32_t hash = 2166136261u;
+	for (unsigned char i = 0; i < length; i++) {
+		hash ^= key[i];
+		hash *= 16777619u;
+	}
+	hash ^= length;
+	hash *= 16777619u;
+	return hash;
+}
+
+/*
+ * Doubles the bucket array and redistributes every entry. Entries are
+ * relinked in place; only the bucket array itself is reallocated.
+ */
+static void thingy_table_grow(struct thingy_table* tbl) {
+	size_t new_count = tbl->bucket_count * 2;
+	struct thingy_entry** new_buckets = calloc(new_count, sizeof(struct thingy_entry*));
+
+	for (size_t i = 0; i < tbl->bucket_count; i++) {
+		struct thingy_entry* entry = tbl->buckets[i];
+		while (entry != NULL) {
+			struct thingy_entry* next = entry->next;
+			size_t bucket = thingy_hash(entry->length, entry->key) & (new_count - 1);
+			entry->next = new_buckets[bucket];
+			new_buckets[bucket] = entry;
+			entry = next;
+		}
+	}
+
+	free(tbl->buckets);
+	tbl->buckets = new_buckets;
+	tbl->bucket_count = new_count;
+}
+
 struct thingy_table* thingy_table_init() {
 	struct thingy_table* nt = malloc(sizeof(struct thingy_table));
 	memset(nt, 0, sizeof(struct thingy_table));
+	nt->bucket_count = THINGY_INITIAL_BUCKETS;
+	nt->buckets = calloc(nt->bucket_count, sizeof(struct thingy_entry*));
 	return nt;
 }
 
 int thingy_table_assign(struct thingy_table* tbl, unsigned char length, const unsigned char*
-		key, const unsigned char* value) { 
+		key, const unsigned char* value) {
 
 	if (length == 0) return 1;
 
@@ -40,42 +95,42 @@ int thingy_table_assign(struct thingy_table* tbl, unsigned char length, const un
 		if (tbl->values[key[0]]) {
 			//key already exists, erase the old one first
 			free(tbl->values[key[0]]);
-			tbl->values[key[0]] = strdup((char*)value);
-			if (tbl->longest_key < length) tbl->longest_key = length;
-			return 0;
-		} else {
-			//key does not exist
-			tbl->values[key[0]] = strdup((char*)value);
-			if (tbl->longest_key < length) tbl->longest_key = length;
-			return 0;
 		}
+		tbl->values[key[0]] = (unsigned char*) strdup((const char*) value);
+		if (tbl->longest_key < length) tbl->longest_key = length;
+		return 0;
 	} else {
-		unsigned char first_char = key[0];
-
-		struct linked_list** curitem = &(tbl->mbseqs[first_char]);
-
-		while (*curitem != NULL) {
+		size_t bucket = thingy_hash(length, key) & (tbl->bucket_count - 1);
 
-			if ( ((*curitem)->length == length) &&
-					(memcmp((*curitem)->key,key,length) == 0) ) {
+		for (struct thingy_entry* entry = tbl->buckets[bucket];
+				entry != NULL; entry = entry->next) {
+			if ((entry->length == length) && (memcmp(entry->key, key, length) == 0)) {
 				//matching key already exists, we need
 				//to replace the value
-
-				free((*curitem)->value);
-				(*curitem)->value = strdup((char*)value);
+				free(entry->value);
+				entry->value = (unsigned char*) strdup((const char*) value);
 				return 0;
 			}
-
-			curitem=&((*curitem)->next);
 		}
 
-		struct linked_list* newitem = malloc(sizeof(struct
-					linked_list));
+		struct thingy_entry* newentry = malloc(sizeof(struct thingy_entry));
+
+		newentry->length = length;
+		//the key can contain any byte, including zeroes, so it is
+		//copied by length rather than as a string.
+		newentry->key = malloc(length);
+		memcpy(newentry->key, key, length);
+		newentry->value = (unsigned char*) strdup((const char*) value);
+		newentry->next = tbl->buckets[bucket];
+		tbl->buckets[bucket] = newentry;
+		tbl->entry_count++;
+
+		//keep the chains short: grow once the table holds as many
+		//entries as there are buckets.
+		if (tbl->entry_count > tbl->bucket_count) {
+			thingy_table_grow(tbl);
+		}
 
-		newitem->length = length;
-		newitem->key = strdup((char*)key);
-		newitem->value = strdup((char*)value);
-		*curitem = newitem;
 		if (tbl->longest_key < length) tbl->longest_key = length;
 		return 0;
 	}
@@ -84,17 +139,19 @@ int thingy_table_assign(struct thingy_table* tbl, unsigned char length, const un
 int thingy_table_destroy(struct thingy_table* tbl) {
 	for (int i=0; i<256; i++) {
 		if (tbl->values[i]) free(tbl->values[i]);
+	}
 
-		struct linked_list* curitem = tbl->mbseqs[i];
-
-		while (curitem != NULL) {
-			struct linked_list* nextitem = curitem->next;
-			free(curitem->key);
-			free(curitem->value);
-			free(curitem);
-			curitem = nextitem;
+	for (size_t i = 0; i < tbl->bucket_count; i++) {
+		struct thingy_entry* entry = tbl->buckets[i];
+		while (entry != NULL) {
+			struct thingy_entry* next = entry->next;
+			free(entry->key);
+			free(entry->value);
+			free(entry);
+			entry = next;
 		}
 	}
+	free(tbl->buckets);
 	free(tbl);
 	return 0;
 }
@@ -105,18 +162,18 @@ const unsigned char* thingy_table_search(struct thingy_table* tbl, unsigned char
 	if (length > tbl->longest_key) return NULL;
 	if (length == 1) return tbl->values[key[0]];
 
-	struct linked_list* curitem = tbl->mbseqs[key[0]];
+	size_t bucket = thingy_hash(length, key) & (tbl->bucket_count - 1);
 
-	while (curitem != NULL) {
-		if ((curitem->length == length) && (memcmp(key,curitem->key,length) == 0))
-			return curitem->value;
-		curitem=curitem->next;
+	for (struct thingy_entry* entry = tbl->buckets[bucket];
+			entry != NULL; entry = entry->next) {
+		if ((entry->length == length) && (memcmp(key, entry->key, length) == 0))
+			return entry->value;
 	}
 	return NULL;
 }
 
 int thingy_table_delete(struct thingy_table* tbl, unsigned char length, const unsigned char* key) {
-	
+
 	if (key == NULL) return 1;
 	if (length == 0) return 1;
 	if (length > tbl->longest_key) return 1;
@@ -127,20 +184,22 @@ int thingy_table_delete(struct thingy_table* tbl, unsigned char length, const un
 		return 0;
 	}
 
-	struct linked_list** curitem_p = &(tbl->mbseqs[key[0]]);
+	size_t bucket = thingy_hash(length, key) & (tbl->bucket_count - 1);
+	struct thingy_entry** entry_p = &(tbl->buckets[bucket]);
+
+	while (*entry_p != NULL) {
 
-	while (*curitem_p != NULL) {
+		if (((*entry_p)->length == length) && (memcmp(key, (*entry_p)->key, length) == 0)) {
 
-		if (((*curitem_p)->length == length) && (memcmp(key,(*curitem_p)->key,length) == 0)) {
-	
-			struct linked_list* nextitem = (*curitem_p)->next;
-			free((*curitem_p)->key);
-			free((*curitem_p)->value);
-			free(*curitem_p);
-			*curitem_p=nextitem;
+			struct thingy_entry* next = (*entry_p)->next;
+			free((*entry_p)->key);
+			free((*entry_p)->value);
+			free(*entry_p);
+			*entry_p = next;
+			tbl->entry_count--;
 			return 0;
 		}
-		curitem_p=&((*curitem_p)->next);
+		entry_p = &((*entry_p)->next);
 	}
 	return 1;
 }
@@ -189,7 +248,7 @@ int thingy_table_add_from_string(struct thingy_table* tbl, const char* string) {
 	} else {
 		value = strtok(NULL,"");
 		if (!value) { 
-			int r = thingy_table_delete(tbl, keylen, key);
+			int r = thingy_table_delete(tbl, keylen, (const unsigned char*) key);
 			free(sd);
 			return 16 + r;
 		}
@@ -9,13 +9,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 static const char* action_names[] = {
 	"delete",
 	"insert",
 	"replace",
-	"append"
+	"append",
+	"rewrite"
 };
 
 const char* action_type_name(enum action_type type) {
@@ -28,22 +30,133 @@ struct action_list* action_list_init() {
 	list->head = NULL;
 	list->tail = NULL;
 	list->curr = NULL;
+	list->slab_head = NULL;
+	list->slab_curr = NULL;
 	return list;
 }
 
-void action_list_add(struct action_list* list, enum action_type type, int offset, unsigned char c) {
-	assert(list != NULL);
+/*
+ * Hands out the next action node by bumping the current slab, reusing a
+ * slab left over from an earlier rewind when available, and allocating a
+ * fresh slab only when the chain is exhausted.
+ */
+static struct action* action_alloc(struct action_list* list) {
+	if (list->slab_curr == NULL || list->slab_curr->used >= UNDO_SLAB_NODES) {
+		if (list->slab_curr != NULL && list->slab_curr->next != NULL) {
+			// A slab recycled by a rewind: start over in it.
+			list->slab_curr = list->slab_curr->next;
+			list->slab_curr->used = 0;
+		} else {
+			struct action_slab* slab = malloc(sizeof(struct action_slab));
+			if (slab == NULL) {
+				perror("Unable to allocate action slab");
+				exit(1);
+			}
+			slab->next = NULL;
+			slab->used = 0;
+			if (list->slab_curr == NULL) {
+				list->slab_head = slab;
+			} else {
+				list->slab_curr->next = slab;
+			}
+			list->slab_curr = slab;
+		}
+	}
+	return &list->slab_curr->nodes[list->slab_curr->used++];
+}
 
-	struct action* action = malloc(sizeof(struct action));
-	action->prev = NULL;
-	action->next = NULL;
-	action->act = type;
-	action->offset = offset;
-	action->c = c;
+/*
+ * Rewinds the slab chain so the next allocation reuses the slot of
+ * `action', which must be the oldest node of a truncated suffix. Later
+ * slabs are kept in the chain and recycled by action_alloc.
+ */
+static void action_rewind(struct action_list* list, struct action* action) {
+	for (struct action_slab* slab = list->slab_head; slab != NULL; slab = slab->next) {
+		if (action >= slab->nodes && action < slab->nodes + UNDO_SLAB_NODES) {
+			slab->used = action - slab->nodes;
+			list->slab_curr = slab;
+			return;
+		}
+	}
+	assert(0 && "action not found in any slab");
+}
+
+/*
+ * Ensures the action's byte span has room for one more byte.
+ */
+static void action_grow(struct action* action) {
+	if (action->len >= action->cap) {
+		action->cap = action->cap == 0 ? 16 : action->cap * 2;
+		action->bytes = realloc(action->bytes, action->cap);
+		if (action->bytes == NULL) {
+			perror("Unable to realloc action bytes");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Tries to extend the tail action with the given byte. This succeeds when
+ * the type matches and the offset continues the tail's span: one position
+ * after it for inserts, appends and replaces (the cursor walking right),
+ * or at/right before its start for deletes (deleting forward or backward).
+ * Returns true when the byte was coalesced into the tail.
+ */
+static bool action_list_coalesce(struct action_list* list, enum action_type type, off_t offset, unsigned char c) {
+	// Only the tail can be extended, and only when no undos are pending.
+	if (list->tail == NULL || list->curr != list->tail || list->curr_status != NODE) {
+		return false;
+	}
+
+	struct action* tail = list->tail;
+	if (tail->act != type) {
+		return false;
+	}
+
+	switch (type) {
+	case ACTION_INSERT:
+	case ACTION_APPEND:
+	case ACTION_REPLACE:
+		if (offset != tail->offset + (off_t) tail->len) {
+			return false;
+		}
+		action_grow(tail);
+		tail->bytes[tail->len++] = c;
+		return true;
+	case ACTION_DELETE:
+		if (offset == tail->offset) {
+			// Deleting forward: the deleted byte followed the span.
+			action_grow(tail);
+			tail->bytes[tail->len++] = c;
+			return true;
+		}
+		if (offset == tail->offset - 1) {
+			// Deleting backward: the deleted byte preceded the span.
+			action_grow(tail);
+			memmove(tail->bytes + 1, tail->bytes, tail->len);
+			tail->bytes[0] = c;
+			tail->len++;
+			tail->offset--;
+			return true;
+		}
+		return false;
+	case ACTION_REWRITE:
+		// Only ever added whole; never extended per byte.
+		return false;
+	}
+	return false;
+}
 
+/*
+ * Allocates a fresh action node and links it in as the new tail. The redo
+ * suffix (everything after curr) is deleted first, so the new node can
+ * reuse its rewound slab slot. The caller fills in the action's contents.
+ */
+static struct action* action_list_push(struct action_list* list, enum action_type type, off_t offset) {
 	// Delete the nodes after curr so as to "reset" the redo state.
 	// If curr IS tail, we want to just add to the end of the list,
-	// so there is nothing to delete.
+	// so there is nothing to delete. This must happen before the new
+	// node is allocated, so the new node can reuse the rewound slot.
 	if (list->head != NULL && list->curr != list->tail) {
 		if (list->curr_status == NODE) {
 			action_list_delete(list, list->curr->next);
@@ -52,6 +165,12 @@ void action_list_add(struct action_list* list, enum action_type type, int offset
 		}
 	}
 
+	struct action* action = action_alloc(list);
+	action->prev = NULL;
+	action->next = NULL;
+	action->act = type;
+	action->offset = offset;
+
 	if (list->head == NULL) {
 		// is this the first node added to the list?
 		list->head = action;
@@ -68,6 +187,47 @@ void action_list_add(struct action_list* list, enum action_type type, int offset
 	// curr is the new action unconditionally.
 	list->curr = action;
 	list->curr_status = NODE;
+	return action;
+}
+
+void action_list_add(struct action_list* list, enum action_type type, off_t offset, unsigned char c) {
+	assert(list != NULL);
+
+	if (action_list_coalesce(list, type, offset, c)) {
+		return;
+	}
+
+	struct action* action = action_list_push(list, type, offset);
+	action->len = 1;
+	action->cap = 16;
+	action->bytes = malloc(action->cap);
+	if (action->bytes == NULL) {
+		perror("Unable to allocate action bytes");
+		exit(1);
+	}
+	action->bytes[0] = c;
+}
+
+void action_list_add_span(struct action_list* list, enum action_type type, off_t offset, unsigned char* bytes, size_t len) {
+	assert(list != NULL);
+	assert(bytes != NULL);
+	assert(len > 0);
+
+	struct action* action = action_list_push(list, type, offset);
+	action->len = len;
+	action->cap = len;
+	action->bytes = bytes;
+}
+
+void action_list_add_rewrite(struct action_list* list, off_t offset, unsigned char* bytes, size_t len, size_t buf_len) {
+	assert(list != NULL);
+	assert(bytes != NULL);
+
+	struct action* action = action_list_push(list, ACTION_REWRITE, offset);
+	action->len = len;
+	action->cap = len;
+	action->bytes = bytes;
+	action->buf_len = buf_len;
 }
 
 void action_list_delete(struct action_list* list, struct action* action) {
@@ -94,15 +254,17 @@ void action_list_delete(struct action_list* list, struct action* action) {
 	bool remove = (action == list->head);
 	bool curr_removed = false;
 
-	// temp node
+	// The deleted nodes are always a suffix of the history, which is a
+	// suffix of the allocation order: free their byte spans, then rewind
+	// the slab chain in one go instead of freeing node-by-node.
 	struct action* node = action;
 	while (node != NULL) {
-		struct action* temp = node;
-		if (list->curr == temp) curr_removed = true;
-		node = temp->next;
-		free(temp);
-		temp = NULL;
+		if (list->curr == node) curr_removed = true;
+		free(node->bytes);
+		node->bytes = NULL;
+		node = node->next;
 	}
+	action_rewind(list, action);
 
 	if (remove) {
 		list->head = NULL;
@@ -121,15 +283,17 @@ void action_list_delete(struct action_list* list, struct action* action) {
 void action_list_free(struct action_list* list) {
 	assert(list != NULL);
 
-	struct action* node = list->head;
-	while (node != NULL) {
-		struct action* temp = node;
-		node = node->next;
+	// The byte spans are owned per node; the nodes themselves all live
+	// in the slabs, so the list is gone after a handful of frees.
+	for (struct action* node = list->head; node != NULL; node = node->next) {
+		free(node->bytes);
+	}
+	struct action_slab* slab = list->slab_head;
+	while (slab != NULL) {
+		struct action_slab* temp = slab;
+		slab = slab->next;
 		free(temp);
 	}
-	// after removing all linked nodes from the head,
-	// dont forget to remove the head as well:
-	free(node);
 	free(list);
 }
 
@@ -141,7 +305,8 @@ void action_list_print(struct action_list* list) {
 		return;
 	}
 	while (node != NULL) {
-		fprintf(stderr, "(%d, %s, %02x) -> ", node->offset, action_names[node->act], node->c);
+		fprintf(stderr, "(%lld, %s, %02x, %zu bytes) -> ", (long long) node->offset,
+				action_names[node->act], node->bytes[0], node->len);
 		node = node->next;
 		if (node == NULL) {
 			fprintf(stderr, "END\n");
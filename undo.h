@@ -7,6 +7,8 @@
 #ifndef HX_UNDO_H
 #define HX_UNDO_H
 
+#include <sys/types.h> // off_t
+
 /*
  * Contains definitions and functions to allow undo/redo actions.
  * It's basically a double-linked list, where the tail is the last
@@ -20,7 +22,8 @@ enum action_type {
 	ACTION_DELETE,  // character deleted
 	ACTION_INSERT,  // character inserted
 	ACTION_REPLACE, // character replaced
-	ACTION_APPEND   // character appended
+	ACTION_APPEND,  // character appended
+	ACTION_REWRITE  // span replaced by a span of a different length
 };
 
 /* The status of the position that curr is currently at. */
@@ -35,16 +38,26 @@ enum curr_pos {
  * This struct contains the data about an action, as well as the pointers
  * to the previous action (or NULL if this is the first), the next action
  * (or NULL if this is the first or last), the type of action, the offset
- * where the action was done, and the character which was deleted, inserted
+ * where the action was done, and the bytes which were deleted, inserted
  * or replaced.
+ *
+ * An action covers a span of bytes rather than a single one: contiguous
+ * runs of same-typed single-byte edits (typing, repeated deletes) are
+ * coalesced into one record by action_list_add, so undo memory is
+ * proportional to the bytes changed instead of one list node per byte,
+ * and undoing a run is a single buffer splice.
  */
 struct action {
 	struct action* prev; // previous action or NULL if first.
 	struct action* next; // next action or NULL if first, or last.
 
 	enum action_type act; // the type of action.
-	int offset;           // the offset where something was changed.
-	unsigned char c;      // the character inserted, deleted, etc.
+	off_t offset;         // the offset where something was changed.
+	size_t len;           // amount of bytes the span covers.
+	size_t cap;           // capacity of `bytes', grown geometrically.
+	unsigned char* bytes; // the bytes inserted, deleted, etc. (`len' of them).
+	size_t buf_len;       // ACTION_REWRITE: length of the span currently in
+	                      // the buffer, which `bytes' replaces on undo/redo.
 };
 
 
@@ -55,15 +68,35 @@ struct action {
  */
 const char* action_type_name(enum action_type type);
 
+// Amount of action nodes per slab.
+#define UNDO_SLAB_NODES 256
+
+/*
+ * A slab of action nodes. Nodes are handed out in order by bumping `used',
+ * so allocating an action for a keystroke does not hit malloc, and slabs
+ * stay around for reuse when the redo tail is truncated. History order and
+ * allocation order are the same (new actions only ever land at the tail),
+ * which is what makes the bump/rewind scheme valid.
+ */
+struct action_slab {
+	struct action_slab* next; // next (newer) slab, or NULL if last.
+	size_t used;              // nodes handed out from this slab.
+	struct action nodes[UNDO_SLAB_NODES];
+};
+
 /*
  * The action_list contains head and tail information. Functions are defined
- * to operate on this struct to add or delete `action's.
+ * to operate on this struct to add or delete `action's. The nodes live in
+ * a chain of slabs owned by the list.
  */
 struct action_list {
 	struct action* head;  // Head/start of the list.
 	struct action* curr;  // Current position within the list.
 	enum curr_pos curr_status; // Meta position of curr.
 	struct action* tail;  // Tail/end of the list.
+
+	struct action_slab* slab_head; // oldest slab, or NULL if none yet.
+	struct action_slab* slab_curr; // slab the next node is handed out from.
 };
 
 /*
@@ -74,9 +107,27 @@ struct action_list* action_list_init();
 
 /*
  * Adds an `action' to the tail of the list by allocating it on the heap, and
- * then setting the pointers correctly.
+ * then setting the pointers correctly. When the byte continues the span of
+ * the tail action (same type, contiguous offset) the tail is extended
+ * instead of a new node being added.
+ */
+void action_list_add(struct action_list* list, enum action_type type, off_t offset, unsigned char c);
+
+/*
+ * Adds one action covering a whole span of `len' bytes at once, for bulk
+ * operations (selection delete/fill, put), so a cut of megabytes is one
+ * record instead of a coalescing step per byte. Takes ownership of the
+ * heap-allocated `bytes'; the list will free() it.
+ */
+void action_list_add_span(struct action_list* list, enum action_type type, off_t offset, unsigned char* bytes, size_t len);
+
+/*
+ * Adds an ACTION_REWRITE covering a span whose length changed: `bytes'
+ * (`len' of them) are the original bytes, `buf_len' is the length of the
+ * span now in the buffer. Undo and redo swap the stored span with the
+ * buffer's. Takes ownership of `bytes' like action_list_add_span.
  */
-void action_list_add(struct action_list* list, enum action_type type, int offset, unsigned char c);
+void action_list_add_rewrite(struct action_list* list, off_t offset, unsigned char* bytes, size_t len, size_t buf_len);
 
 /*
  * Deletes an `action' from the list. All trailing actions are freed as well.
@@ -4,6 +4,7 @@
  * Copyright (c) 2016 Kevin Pors. See LICENSE for details.
  */
 #include "util.h"
+#include "charbuf.h"
 
 #include <ctype.h>
 #include <errno.h>
@@ -14,13 +15,187 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/select.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // Terminal IO settings. Used to reset it when exiting to prevent terminal
 // data garbling. See enable/disable_raw_mode().
 static struct termios orig_termios;
 
+/*
+ * Scalar Boyer-Moore-Horspool search. The skip table holds, for every
+ * byte value, how far the search position can jump when the last byte of
+ * the current window is that value, so mismatches skip up to needlelen
+ * bytes at once instead of advancing one position at a time.
+ */
+static void* memmem_horspool(const unsigned char* h, size_t hn,
+                             const unsigned char* n, size_t nn) {
+	size_t skip[256];
+	for (int i = 0; i < 256; i++) {
+		skip[i] = nn;
+	}
+	for (size_t i = 0; i < nn - 1; i++) {
+		skip[n[i]] = nn - 1 - i;
+	}
+
+	size_t pos = 0;
+	while (pos + nn <= hn) {
+		unsigned char last = h[pos + nn - 1];
+		if (last == n[nn - 1] && memcmp(h + pos, n, nn - 1) == 0) {
+			return (void*) (h + pos);
+		}
+		pos += skip[last];
+	}
+	return NULL;
+}
+
+#ifdef __SSE2__
+/*
+ * SSE2 filter: compare 16 candidate positions at once against the first
+ * and the last byte of the needle, and only run a memcmp on positions
+ * where both match. The tail that does not fill a 16-byte block is
+ * handled by the scalar Horspool search.
+ */
+static void* memmem_sse2(const unsigned char* h, size_t hn,
+                         const unsigned char* n, size_t nn) {
+	const __m128i first = _mm_set1_epi8(n[0]);
+	const __m128i last = _mm_set1_epi8(n[nn - 1]);
+
+	size_t pos = 0;
+	while (pos + nn - 1 + 16 <= hn) {
+		__m128i bf = _mm_loadu_si128((const __m128i*) (h + pos));
+		__m128i bl = _mm_loadu_si128((const __m128i*) (h + pos + nn - 1));
+		unsigned int mask = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(bf, first),
+			              _mm_cmpeq_epi8(bl, last)));
+		while (mask != 0) {
+			int bit = __builtin_ctz(mask);
+			if (memcmp(h + pos + bit + 1, n + 1, nn - 2) == 0) {
+				return (void*) (h + pos + bit);
+			}
+			mask &= mask - 1;
+		}
+		pos += 16;
+	}
+
+	if (pos + nn <= hn) {
+		return memmem_horspool(h + pos, hn - pos, n, nn);
+	}
+	return NULL;
+}
+#endif
+
+void* hx_memmem(const void* haystack, size_t haylen, const void* needle, size_t needlelen) {
+	const unsigned char* h = haystack;
+	const unsigned char* n = needle;
+
+	if (needlelen == 0 || needlelen > haylen) {
+		return NULL;
+	}
+	if (needlelen == 1) {
+		return memchr(haystack, n[0], haylen);
+	}
+
+#ifdef __SSE2__
+	return memmem_sse2(h, haylen, n, needlelen);
+#else
+	return memmem_horspool(h, haylen, n, needlelen);
+#endif
+}
+
+void* hx_memrmem(const void* haystack, size_t haylen, const void* needle, size_t needlelen) {
+	const unsigned char* h = haystack;
+	const unsigned char* n = needle;
+
+	if (needlelen == 0 || needlelen > haylen) {
+		return NULL;
+	}
+
+	// Horspool mirrored: scan right to left, skipping on the first byte
+	// of the current window.
+	size_t skip[256];
+	for (int i = 0; i < 256; i++) {
+		skip[i] = needlelen;
+	}
+	for (size_t i = needlelen - 1; i > 0; i--) {
+		skip[n[i]] = i;
+	}
+
+	size_t pos = haylen - needlelen;
+	for (;;) {
+		unsigned char head = h[pos];
+		if (head == n[0] && memcmp(h + pos + 1, n + 1, needlelen - 1) == 0) {
+			return (void*) (h + pos);
+		}
+		size_t s = skip[head];
+		if (pos < s) {
+			return NULL;
+		}
+		pos -= s;
+	}
+}
+
+#ifdef __SSE2__
+/*
+ * Mask of the printable bytes (0x20..0x7e) in a 16-byte block, one bit
+ * per byte. Both compares are signed, which conveniently rejects bytes
+ * 0x80 and up: they are negative and fail the > 0x1f test.
+ */
+static unsigned int printable_mask(const unsigned char* p) {
+	__m128i b = _mm_loadu_si128((const __m128i*) p);
+	__m128i lo = _mm_cmpgt_epi8(b, _mm_set1_epi8(0x1f));
+	__m128i hi = _mm_cmplt_epi8(b, _mm_set1_epi8(0x7f));
+	return _mm_movemask_epi8(_mm_and_si128(lo, hi));
+}
+#endif
+
+void* hx_findprint(const void* buf, size_t len) {
+	const unsigned char* p = buf;
+	size_t pos = 0;
+#ifdef __SSE2__
+	while (pos + 16 <= len) {
+		unsigned int mask = printable_mask(p + pos);
+		if (mask != 0) {
+			return (void*) (p + pos + __builtin_ctz(mask));
+		}
+		pos += 16;
+	}
+#endif
+	for (; pos < len; pos++) {
+		if (p[pos] >= 0x20 && p[pos] <= 0x7e) {
+			return (void*) (p + pos);
+		}
+	}
+	return NULL;
+}
+
+size_t hx_printable_prefix(const void* buf, size_t len) {
+	const unsigned char* p = buf;
+	size_t pos = 0;
+#ifdef __SSE2__
+	while (pos + 16 <= len) {
+		unsigned int mask = printable_mask(p + pos);
+		if (mask != 0xffff) {
+			return pos + __builtin_ctz(~mask & 0xffff);
+		}
+		pos += 16;
+	}
+#endif
+	for (; pos < len; pos++) {
+		if (p[pos] < 0x20 || p[pos] > 0x7e) {
+			break;
+		}
+	}
+	return pos;
+}
+
 int hex2bin(const char* s) {
 	int ret=0;
 	for(int i = 0; i < 2; i++) {
@@ -67,6 +242,17 @@ int hex2int(const char* s) {
 	return x;
 }
 
+off_t hex2off(const char* s) {
+	char* endptr;
+	errno = 0;
+	intmax_t x = strtoimax(s, &endptr, 16);
+	if (errno == ERANGE) {
+		return 0;
+	}
+
+	return x;
+}
+
 inline int clampi(int i, int min, int max) {
 	if (i < min) {
 		return min;
@@ -90,6 +276,89 @@ int str2int(const char* s, int min, int max, int def) {
 	return x;
 }
 
+off_t str2off(const char* s, off_t min, off_t max, off_t def) {
+	char* endptr;
+	errno = 0;
+	intmax_t x = strtoimax(s, &endptr, 10);
+	if (errno  == ERANGE) {
+		return def;
+	}
+	if (x < min || x > max) {
+		return def;
+	}
+	return x;
+}
+
+long long time_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+// Time spent blocked in read() waiting for input, see input_idle_collect.
+static long long input_idle_ns = 0;
+
+long long input_idle_collect() {
+	long long idle = input_idle_ns;
+	input_idle_ns = 0;
+	return idle;
+}
+
+long long get_rss_bytes() {
+	FILE* fp = fopen("/proc/self/statm", "r");
+	if (fp != NULL) {
+		long long size;
+		long long resident;
+		if (fscanf(fp, "%lld %lld", &size, &resident) == 2) {
+			fclose(fp);
+			return resident * sysconf(_SC_PAGESIZE);
+		}
+		fclose(fp);
+	}
+
+	// No procfs: fall back to the peak resident size, reported in KB.
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (long long) ru.ru_maxrss * 1024;
+}
+
+// Buffered stdin bytes. read_key() refills this with a single read() of
+// everything available and serves subsequent keys from it, so a paste of
+// a few KB costs a handful of read syscalls instead of one per byte.
+#define INPUT_BUF_BYTES 1024
+static unsigned char input_buf[INPUT_BUF_BYTES];
+static size_t input_buf_len = 0;
+static size_t input_buf_pos = 0;
+
+/*
+ * Returns the next raw input byte, refilling the buffer with one read()
+ * when it is empty. When `block' is false, an empty read (the raw-mode
+ * read timeout) returns -1 instead of retrying; that is how the escape
+ * sequence lookahead distinguishes a lone ESC press from a sequence.
+ */
+static int input_next_byte(bool block) {
+	if (input_buf_pos >= input_buf_len) {
+		ssize_t nread;
+		long long start = time_ns();
+		// check == 0 to see if EOF.
+		while ((nread = read(STDIN_FILENO, input_buf, sizeof(input_buf))) == 0) {
+			if (!block) {
+				return -1;
+			}
+		}
+		input_idle_ns += time_ns() - start;
+		if (nread == -1) {
+			// When the read call is interrupted by a signal (such as
+			// SIGWINCH), the nread will be -1. In that case, just return
+			// -1 prematurely and continue the main loop.
+			return -1;
+		}
+		input_buf_len = nread;
+		input_buf_pos = 0;
+	}
+	return input_buf[input_buf_pos++];
+}
+
 /*
  * Reads keypresses from stdin, and processes them accordingly. Escape sequences
  * will be read properly as well (e.g. DEL will be the bytes 0x1b, 0x5b, 0x33, 0x7e).
@@ -98,18 +367,12 @@ int str2int(const char* s, int min, int max, int def) {
  * read_key() will only return the correct key code, or -1 when anything fails.
  */
 int read_key() {
-	char c;
-	ssize_t nread;
-	// check == 0 to see if EOF.
-	while ((nread = read(STDIN_FILENO, &c, 1)) == 0);
-	if (nread == -1) {
-		// When the read call is interrupted by a signal (such as SIGWINCH), the
-		// nread will be -1. In that case, just return -1 prematurely and continue
-		// the main loop.
+	int c = input_next_byte(true);
+	if (c == -1) {
 		return -1;
 	}
 
-	char seq[4]; // escape sequence buffer.
+	int seq[4]; // escape sequence buffer.
 
 	switch (c) {
 	case KEY_BACKSPACE:
@@ -120,10 +383,10 @@ int read_key() {
 		// So we will try to read ahead a few bytes, and see if there's more.
 		// For instance, a single Escape key only produces a single 0x1b char.
 		// A delete key produces 0x1b 0x5b 0x33 0x7e.
-		if (read(STDIN_FILENO, seq, 1) == 0) {
+		if ((seq[0] = input_next_byte(false)) == -1) {
 			return KEY_ESC;
 		}
-		if (read(STDIN_FILENO, seq + 1, 1) == 0) {
+		if ((seq[1] = input_next_byte(false)) == -1) {
 			return KEY_ESC;
 		}
 
@@ -134,7 +397,7 @@ int read_key() {
 
 		if (seq[0] == '[') {
 			if (seq[1] >= '0' && seq[1] <= '9') {
-				if (read(STDIN_FILENO, seq + 2, 1) == 0) {
+				if ((seq[2] = input_next_byte(false)) == -1) {
 					return KEY_ESC;
 				}
 				if (seq[2] == '~') {
@@ -173,11 +436,32 @@ int read_key() {
 	return c;
 }
 
+bool key_available(int ms) {
+	// Bytes already drained into the input buffer count as available;
+	// select() only sees what is still in the kernel.
+	if (input_buf_pos < input_buf_len) {
+		return true;
+	}
+
+	fd_set readfds;
+	FD_ZERO(&readfds);
+	FD_SET(STDIN_FILENO, &readfds);
+
+	struct timeval tv;
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+
+	return select(STDIN_FILENO + 1, &readfds, NULL, NULL, &tv) > 0;
+}
+
 bool get_window_size(int* rows, int* cols) {
 	struct winsize ws;
 	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0) {
-		perror("Failed to query terminal size");
-		exit(1);
+		// Not a terminal (e.g. the bench harness with output redirected):
+		// fall back to a classic 80x24 so the caller can carry on.
+		*rows = 24;
+		*cols = 80;
+		return false;
 	}
 
 	*rows = ws.ws_row;
@@ -249,5 +533,8 @@ void clear_screen() {
 	if (write(STDOUT_FILENO, stuff, bw) == -1) {
 		perror("Unable to clear screen");
 	}
+	// This write went behind the frame diff's back, so the next draw
+	// must not skip anything.
+	charbuf_draw_invalidate();
 }
 
@@ -8,6 +8,7 @@
 #define HX_UTIL_H
 
 #include <stdbool.h>
+#include <sys/types.h> // off_t
 #include <termios.h>
 
 // Key enumeration, returned by read_key().
@@ -64,6 +65,14 @@ void enable_raw_mode();
 void disable_raw_mode();
 void clear_screen();
 int  read_key();
+
+/*
+ * Waits up to `ms' milliseconds for input on stdin. Returns true when a
+ * key is available to be read with read_key(), false on timeout. Used to
+ * keep polling loops (such as a background search) responsive without
+ * blocking on read().
+ */
+bool key_available(int ms);
 int  hex2bin(const char* s);
 bool get_window_size(int* rows, int* cols);
 
@@ -81,6 +90,59 @@ bool is_hex(const char* s);
 
 int hex2int(const char* s);
 
+/*
+ * Returns a monotonic timestamp in nanoseconds, for measuring durations.
+ */
+long long time_ns();
+
+/*
+ * Returns the nanoseconds spent blocked waiting for input since the last
+ * call, and resets the counter. Used by the performance HUD to subtract
+ * the wait for the user from the input handling time.
+ */
+long long input_idle_collect();
+
+/*
+ * Returns the current resident set size in bytes, read from procfs, or
+ * the peak resident size on systems without /proc.
+ */
+long long get_rss_bytes();
+
+/*
+ * As hex2int, but returns an off_t so offsets beyond 2 GB in large files
+ * can be addressed.
+ */
+off_t hex2off(const char* s);
+
+/*
+ * Finds the first occurrence of the byte string `needle' (of `needlelen'
+ * bytes) in `haystack' (of `haylen' bytes) and returns a pointer to it,
+ * or NULL when it does not occur. Unlike a naive memcmp-at-every-offset
+ * scan this uses a Boyer-Moore-Horspool skip table, with an SSE2
+ * first/last-byte filter where available, so searching a large buffer
+ * skips ahead instead of comparing at every single offset.
+ */
+void* hx_memmem(const void* haystack, size_t haylen, const void* needle, size_t needlelen);
+
+/*
+ * As hx_memmem, but returns the last occurrence instead of the first.
+ */
+void* hx_memrmem(const void* haystack, size_t haylen, const void* needle, size_t needlelen);
+
+/*
+ * Returns a pointer to the first printable byte (0x20..0x7e) in `buf',
+ * or NULL when there is none. The same printable test the render path
+ * makes per byte, done 16 bytes per compare with SSE2 when available.
+ */
+void* hx_findprint(const void* buf, size_t len);
+
+/*
+ * Returns the length of the printable run at the start of `buf', up to
+ * `len'. Together with hx_findprint this classifies a buffer into
+ * printable runs without a per-byte isprint call.
+ */
+size_t hx_printable_prefix(const void* buf, size_t len);
+
 /*
  * Clamps the given integer i to the given min or max. If i is smaller than
  * min, min is returned. If i is larger than max, max is returned. In all
@@ -97,4 +159,10 @@ int clampi(int i, int min, int max);
  */
 int str2int(const char* s, int min, int max, int def);
 
+/*
+ * As str2int, but operating on off_t so offsets beyond 2 GB in large
+ * files can be addressed.
+ */
+off_t str2off(const char* s, off_t min, off_t max, off_t def);
+
 #endif // HX_UTIL_H